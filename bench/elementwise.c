@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <vkhel.h>
+#include "priv/tuning.h"
+#include "priv/vkhel.h"
+
+/* memory throughput of the elementwise kernels at each number of
+ * elements per invocation; more than one loads and stores pairs */
+
+#define LENGTH ((uint64_t) 1 << 22)
+#define LOCAL_SIZE 64
+
+static const struct {
+	enum vulkan_kernel_type type;
+	const char *name;
+	/* elements read and written per result */
+	uint32_t accesses;
+} kernels[] = {
+	{ VULKAN_KERNEL_TYPE_ELEMFMA, "elemfma", 3 },
+	{ VULKAN_KERNEL_TYPE_ELEMMUL, "elemmul", 3 },
+	{ VULKAN_KERNEL_TYPE_ELEMGTADD, "elemgtadd", 2 },
+	{ VULKAN_KERNEL_TYPE_ELEMGTSUB, "elemgtsub", 2 },
+	{ VULKAN_KERNEL_TYPE_ELEMMULCONST, "elemmulconst", 2 },
+	{ VULKAN_KERNEL_TYPE_ELEMMODBYTWO, "elemmodbytwo", 2 },
+};
+
+static const uint32_t elements_per_invocation[] = { 1, 2, 4, 8 };
+
+int main() {
+	struct vkhel_ctx *ctx = vkhel_ctx_create();
+
+	printf("%-14s", "kernel");
+	for (size_t j = 0; j < sizeof(elements_per_invocation)
+			/ sizeof(elements_per_invocation[0]); j++) {
+		printf("%10u/inv", elements_per_invocation[j]);
+	}
+	printf("   (GB/s, %llu elements)\n", (unsigned long long) LENGTH);
+
+	for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+		printf("%-14s", kernels[i].name);
+		for (size_t j = 0; j < sizeof(elements_per_invocation)
+				/ sizeof(elements_per_invocation[0]); j++) {
+			vulkan_ctx_set_kernel_shape(&ctx->vk, kernels[i].type,
+					LOCAL_SIZE, elements_per_invocation[j]);
+			const double seconds =
+				tuning_benchmark(ctx, kernels[i].type, LENGTH);
+			const double bytes = kernels[i].accesses * sizeof(uint64_t);
+			printf("%14.1f", bytes / seconds / 1e9);
+		}
+		printf("\n");
+	}
+
+	vkhel_ctx_destroy(ctx);
+	return 0;
+}
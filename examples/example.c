@@ -5,7 +5,8 @@
 
 static void print_vector(struct vkhel_vector *vec, size_t vec_length) {
 	uint64_t *mapped;
-	vkhel_vector_map(vec, (void **) &mapped, vec_length);
+	vkhel_vector_map(vec, (void **) &mapped,
+			vec_length * sizeof(uint64_t));
 	printf("{");
 	for (size_t i = 0; i < vec_length; i++) {
 		printf("%" PRIu64 ", ", mapped[i]);
@@ -29,14 +30,16 @@ int main() {
 	vkhel_vector_copy_from_host(b, b_elements);
 
 	uint64_t *a_map;
-	vkhel_vector_map(a, (void **) &a_map, 4);
+	vkhel_vector_map(a, (void **) &a_map,
+			vector_len * sizeof(uint64_t));
 	for (size_t i = 0; i < vector_len; i++) {
 		assert(a_map[i] == a_elements[i]);
 	}
 	vkhel_vector_unmap(a);
 
 	uint64_t *b_map;
-	vkhel_vector_map(b, (void **) &b_map, 4);
+	vkhel_vector_map(b, (void **) &b_map,
+			vector_len * sizeof(uint64_t));
 	for (size_t i = 0; i < vector_len; i++) {
 		assert(b_map[i] == b_elements[i]);
 	}
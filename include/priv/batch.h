@@ -0,0 +1,63 @@
+#ifndef PRIV_BATCH_H
+#define PRIV_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct vkhel_ctx;
+struct vkhel_ntt_tables;
+struct vkhel_vector;
+
+enum batch_op_type {
+	BATCH_OP_TYPE_ELEMFMA,
+	BATCH_OP_TYPE_ELEMMOD,
+	BATCH_OP_TYPE_ELEMMUL,
+	BATCH_OP_TYPE_ELEMGTADD,
+	BATCH_OP_TYPE_ELEMGTSUB,
+	BATCH_OP_TYPE_FORWARD_TRANSFORM,
+	BATCH_OP_TYPE_INVERSE_TRANSFORM,
+};
+
+#define BATCH_OP_MAX_OPERANDS 2
+
+struct batch_op {
+	enum batch_op_type type;
+
+	/* unused operands are NULL */
+	const struct vkhel_vector *operands[BATCH_OP_MAX_OPERANDS];
+	struct vkhel_vector *result;
+
+	union {
+		struct {
+			uint64_t multiplier;
+			uint64_t mod;
+		} elemfma;
+		struct {
+			uint64_t mod;
+			uint64_t q;
+		} elemmod;
+		struct {
+			uint64_t mod;
+		} elemmul;
+		struct {
+			uint64_t bound;
+			uint64_t diff;
+		} elemgtadd;
+		struct {
+			uint64_t bound;
+			uint64_t diff;
+			uint64_t mod;
+		} elemgtsub;
+		struct vkhel_ntt_tables *ntt;
+	};
+};
+
+struct vkhel_batch {
+	struct vkhel_ctx *ctx;
+
+	struct batch_op *ops;
+	size_t op_count;
+	size_t op_capacity;
+};
+
+#endif
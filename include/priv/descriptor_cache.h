@@ -0,0 +1,62 @@
+#ifndef PRIV_DESCRIPTOR_CACHE_H
+#define PRIV_DESCRIPTOR_CACHE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <vk_mem_alloc.h>
+
+struct vulkan_ctx;
+struct vulkan_kernel;
+
+#define DESCRIPTOR_CACHE_MAX_BUFFERS 4
+#define DESCRIPTOR_CACHE_BUCKET_COUNT 256
+#define DESCRIPTOR_CACHE_POOL_SETS 256
+
+struct descriptor_cache_entry {
+	struct descriptor_cache_entry *next;
+
+	/* key */
+	const struct vulkan_kernel *kernel;
+	size_t buffer_count;
+	VkDescriptorBufferInfo buffers[DESCRIPTOR_CACHE_MAX_BUFFERS];
+
+	/* index into the cache's pools */
+	size_t pool_index;
+	VkDescriptorSet set;
+};
+
+struct descriptor_cache_pool {
+	VkDescriptorPool pool;
+	/* sets freed by invalidation are allocated again */
+	uint32_t free_sets;
+};
+
+struct descriptor_cache {
+	/* the cache is shared by every thread using the context */
+	pthread_mutex_t lock;
+
+	struct descriptor_cache_entry *buckets[DESCRIPTOR_CACHE_BUCKET_COUNT];
+	size_t entry_count;
+
+	/* sets are allocated from any pool with room, newest first; a new
+	 * one is added when all of them are full */
+	struct descriptor_cache_pool *pools;
+	size_t pool_count;
+};
+
+/* returns a set with the buffers written to the kernel's bindings in order;
+ * cached sets are never updated, so they can be shared by pending
+ * executions */
+void descriptor_cache_init(struct vulkan_ctx *vk);
+VkDescriptorSet descriptor_cache_get(struct vulkan_ctx *vk,
+		const struct vulkan_kernel *kernel,
+		const VkDescriptorBufferInfo *buffers, size_t buffer_count);
+/* frees every set referencing the buffer, which must no longer be in use */
+void descriptor_cache_invalidate(struct vulkan_ctx *vk, VkBuffer buffer);
+/* frees every set binding exactly this range of a buffer, which must no
+ * longer be in use */
+void descriptor_cache_invalidate_range(struct vulkan_ctx *vk,
+		const VkDescriptorBufferInfo *range);
+void descriptor_cache_finish(struct vulkan_ctx *vk);
+
+#endif
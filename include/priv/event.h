@@ -0,0 +1,18 @@
+#ifndef PRIV_EVENT_H
+#define PRIV_EVENT_H
+
+#include "priv/vulkan.h"
+
+struct vkhel_ctx;
+
+struct vkhel_event {
+	struct vkhel_ctx *ctx;
+
+	/* signaled once the execution is done, then returned to the context */
+	VkFence fence;
+	struct vulkan_execution execution;
+};
+
+struct vkhel_event *vkhel_event_create(struct vkhel_ctx *ctx);
+
+#endif
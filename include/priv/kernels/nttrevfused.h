@@ -0,0 +1,25 @@
+#ifndef PRIV_KERNELS_NTTREVFUSED
+#define PRIV_KERNELS_NTTREVFUSED
+
+#include <stdint.h>
+
+/* largest transform size whose blocks fit in the kernel's shared memory */
+#define NTTREVFUSED_MAX_TRANSFORM_SIZE 512
+
+struct vulkan_ctx;
+struct vulkan_kernel;
+struct vulkan_execution;
+struct vkhel_vector;
+struct vkhel_ntt_tables;
+
+void vulkan_kernel_nttrevfused_init(struct vulkan_ctx *);
+void vulkan_kernel_nttrevfused_record(
+		struct vulkan_ctx *vk,
+		struct vulkan_kernel *kernel,
+		struct vulkan_execution *execution,
+		struct vkhel_ntt_tables *ntt,
+		uint64_t transform_size,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result);
+
+#endif
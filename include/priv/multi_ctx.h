@@ -0,0 +1,14 @@
+#ifndef PRIV_MULTI_CTX_H
+#define PRIV_MULTI_CTX_H
+
+#include <stddef.h>
+
+struct vkhel_ctx;
+
+struct vkhel_multi_ctx {
+	/* one context per suitable device, in enumeration order */
+	struct vkhel_ctx **devices;
+	size_t device_count;
+};
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef PRIV_NTT_PLAN_H
+#define PRIV_NTT_PLAN_H
+
+#include <pthread.h>
+#include <vk_mem_alloc.h>
+
+struct vkhel_ctx;
+struct vkhel_ntt_tables;
+struct vkhel_vector;
+
+enum ntt_plan_direction {
+	NTT_PLAN_DIRECTION_FORWARD	= 0,
+	NTT_PLAN_DIRECTION_INVERSE	= 1,
+	NTT_PLAN_DIRECTION_MAX,
+};
+
+struct vkhel_ntt_plan {
+	struct vkhel_ctx *ctx;
+
+	struct vkhel_ntt_tables *ntt;
+	const struct vkhel_vector *operand;
+	struct vkhel_vector *result;
+
+	/* owned by the plan so the recorded command buffers outlive any op */
+	VkCommandPool cmd_pool;
+	VkCommandBuffer cmd_buffers[NTT_PLAN_DIRECTION_MAX];
+	/* runs hold it from submission to the fence, as the command buffers
+	 * can't be pending twice and the fence is shared */
+	pthread_mutex_t run_lock;
+	VkFence fence;
+};
+
+#endif
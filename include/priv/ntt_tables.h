@@ -1,8 +1,21 @@
 #ifndef PRIV_NTT_TABLES_H
 #define PRIV_NTT_TABLES_H
 
+#include <pthread.h>
 #include <stdint.h>
 
+struct vkhel_ctx;
+struct vkhel_vector;
+
+struct ntt_device_tables {
+	struct ntt_device_tables *next;
+	struct vkhel_ctx *ctx;
+	struct vkhel_vector *roots_of_unity;
+	struct vkhel_vector *inv_roots_of_unity;
+	struct vkhel_vector *roots_barrett_factors;
+	struct vkhel_vector *inv_roots_barrett_factors;
+};
+
 struct vkhel_ntt_tables {
 	uint64_t n; /* degree */
 	uint64_t q; /* modulus */
@@ -12,8 +25,18 @@ struct vkhel_ntt_tables {
 	uint64_t *inv_roots_of_unity;
 	uint64_t *roots_barrett_factors;
 	uint64_t *inv_roots_barrett_factors;
+
+	/* device copies of the tables above, uploaded to each context on its
+	 * first use and kept until the tables are destroyed, since recorded
+	 * work may still read them; the lock lets threads share the tables */
+	pthread_mutex_t lock;
+	struct ntt_device_tables *device_tables;
 };
 
 void vkhel_ntt_tables_dbgprint(struct vkhel_ntt_tables *);
+void vkhel_ntt_tables_upload(struct vkhel_ntt_tables *, struct vkhel_ctx *);
+/* the copies on a context the tables were already uploaded to */
+const struct ntt_device_tables *vkhel_ntt_tables_device(
+		struct vkhel_ntt_tables *, const struct vkhel_ctx *);
 
 #endif
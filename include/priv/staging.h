@@ -0,0 +1,50 @@
+#ifndef PRIV_STAGING_H
+#define PRIV_STAGING_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vk_mem_alloc.h>
+
+struct vulkan_ctx;
+
+#define STAGING_CHUNK_SIZE (2 * 1024 * 1024)
+#define STAGING_CHUNK_COUNT 4
+
+/* persistently mapped host memory that every transfer between the host and
+ * device buffers goes through in chunks; the host copies into or out of one
+ * chunk while the transfer queue copies the others */
+struct staging_ring {
+	/* a transfer holds the ring until all of its chunks are done */
+	pthread_mutex_t lock;
+	/* created on the first transfer, mapped is NULL until then */
+	VkBuffer buffer;
+	VmaAllocation allocation;
+	uint8_t *mapped;
+};
+
+/* one range of a device buffer and its host counterpart */
+struct staging_copy {
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	/* the source of uploads, the destination of downloads */
+	void *host;
+	VkDeviceSize size;
+};
+
+void staging_ring_init(struct vulkan_ctx *vk);
+/* the copies are packed back to back into the chunks, so small ones share
+ * a submission and a fence */
+void staging_ring_upload_many(struct vulkan_ctx *vk,
+		const struct staging_copy *copies, size_t count);
+void staging_ring_download_many(struct vulkan_ctx *vk,
+		const struct staging_copy *copies, size_t count);
+/* copies size bytes from the host to the buffer at offset */
+void staging_ring_upload(struct vulkan_ctx *vk, VkBuffer buffer,
+		VkDeviceSize offset, const void *src, VkDeviceSize size);
+/* copies size bytes from the buffer at offset to the host */
+void staging_ring_download(struct vulkan_ctx *vk, VkBuffer buffer,
+		VkDeviceSize offset, void *dst, VkDeviceSize size);
+void staging_ring_finish(struct vulkan_ctx *vk);
+
+#endif
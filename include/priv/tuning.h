@@ -0,0 +1,22 @@
+#ifndef PRIV_TUNING_H
+#define PRIV_TUNING_H
+
+#include <stdbool.h>
+#include "priv/vulkan.h"
+
+struct vkhel_ctx;
+
+/* a tuning file holds lines of "<device uuid> <kernel> <local size>
+ * <elements per invocation>", so several devices can share one file */
+
+/* applies the entries for the context's device, if the file has any */
+void tuning_load(struct vulkan_ctx *vk, const char *path);
+/* replaces the entries for the context's device with its current sizes */
+bool tuning_save(const struct vulkan_ctx *vk, const char *path);
+
+/* seconds per element of the kernel in its current shape over vectors of
+ * the given length, best of a few runs */
+double tuning_benchmark(struct vkhel_ctx *ctx, enum vulkan_kernel_type type,
+		uint64_t length);
+
+#endif
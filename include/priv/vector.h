@@ -3,22 +3,54 @@
 
 #include <stdlib.h>
 #include <vk_mem_alloc.h>
+#include <vkhel.h>
 
 struct vkhel_ctx;
+struct vkhel_ntt_tables;
+struct vulkan_ctx;
+struct vulkan_execution;
 
 struct backing_memory {
 	VmaAllocation allocation;
 	VkBuffer buffer;
+	/* persistently mapped storage, NULL unless the memory is host visible */
+	void *mapped;
+	/* of the buffer, which may be larger than the vector using it */
+	VkDeviceSize size;
 };
 
 struct vkhel_vector {
 	struct vkhel_ctx *ctx;
 
 	size_t length;
+	/* views share the device memory of the vector that owns it, starting
+	 * offset bytes in */
+	struct vkhel_vector *parent;
+	VkDeviceSize offset;
 	struct backing_memory device;
-	struct backing_memory host;
+	/* the mapped range while the vector is mapped, with its offset in the
+	 * buffer; either the device storage itself or a host copy of it */
+	void *mapped;
+	size_t mapped_offset;
+	size_t mapped_size;
+	enum vkhel_map_mode map_mode;
 };
 
 void vkhel_vector_dbgprint(const struct vkhel_vector *);
+/* the range of the buffer kernels bind for the vector */
+VkDescriptorBufferInfo vkhel_vector_buffer_info(
+		const struct vkhel_vector *vector);
+
+/* the tables must already be uploaded to the vectors' context */
+void vkhel_vector_record_forward_transform(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		struct vkhel_ntt_tables *ntt);
+void vkhel_vector_record_inverse_transform(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		struct vkhel_ntt_tables *ntt);
 
 #endif
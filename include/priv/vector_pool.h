@@ -0,0 +1,53 @@
+#ifndef PRIV_VECTOR_POOL_H
+#define PRIV_VECTOR_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "priv/vector.h"
+
+struct vulkan_ctx;
+
+/* buffers are created with a power of two size, at least 256 bytes */
+#define VECTOR_POOL_MIN_CLASS 8
+#define VECTOR_POOL_CLASS_COUNT 64
+
+struct vector_pool_entry {
+	struct vector_pool_entry *next;
+	struct backing_memory memory;
+};
+
+/* device buffers of destroyed vectors, kept by size class for the next
+ * vectors of that class */
+struct vector_pool {
+	pthread_mutex_t lock;
+	struct vector_pool_entry *classes[VECTOR_POOL_CLASS_COUNT];
+	uint32_t class_counts[VECTOR_POOL_CLASS_COUNT];
+	uint64_t retained_bytes;
+
+	/* 0 bytes disables the pool, and buffers get their exact size */
+	uint64_t max_bytes;
+	uint32_t max_per_class;
+};
+
+void vector_pool_init(struct vector_pool *pool, uint64_t max_bytes,
+		uint32_t max_per_class);
+/* the size to create a buffer of size bytes with, so it can be pooled if
+ * its class fits in the pool */
+uint64_t vector_pool_buffer_size(const struct vector_pool *pool,
+		uint64_t size);
+/* takes a pooled buffer of at least size bytes, returns false if there
+ * is none */
+bool vector_pool_take(struct vector_pool *pool, uint64_t size,
+		struct backing_memory *memory);
+/* keeps the buffer for reuse, or destroys it if the pool is full; it must
+ * no longer be in use */
+void vector_pool_release(struct vulkan_ctx *vk, struct vector_pool *pool,
+		const struct backing_memory *memory);
+/* destroys pooled buffers, largest first, until at most keep_bytes are
+ * retained */
+void vector_pool_trim(struct vulkan_ctx *vk, struct vector_pool *pool,
+		uint64_t keep_bytes);
+void vector_pool_finish(struct vulkan_ctx *vk, struct vector_pool *pool);
+
+#endif
@@ -3,12 +3,14 @@
 
 #include <vkhel.h>
 #include "priv/vector.h"
+#include "priv/vector_pool.h"
 #include "priv/vulkan.h"
 
 #define DIV_CEIL(a, b) ((a + b - 1) / b)
 
 struct vkhel_ctx {
 	struct vulkan_ctx vk;
+	struct vector_pool pool;
 };
 
 #endif
@@ -1,16 +1,63 @@
 #ifndef PRIV_VULKAN_H
 #define PRIV_VULKAN_H
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <vk_mem_alloc.h>
+#include "priv/descriptor_cache.h"
+#include "priv/staging.h"
 
+struct vkhel_ctx_options;
 struct vulkan_ctx;
 
+/* a pipeline of a kernel with its modulus, and optionally its workgroup
+ * size, fixed through specialization constants */
+struct vulkan_kernel_variant {
+	struct vulkan_kernel_variant *next;
+	uint64_t mod;
+	uint32_t local_size;
+	uint32_t elements_per_invocation;
+	/* the local size was asked for, rather than taken from the kernel */
+	bool fixed_local_size;
+	VkPipeline pipeline;
+};
+
+/* a pipeline replaced by a new kernel shape while a live plan may have
+ * recorded it */
+struct vulkan_retired_pipeline {
+	struct vulkan_retired_pipeline *next;
+	VkPipeline pipeline;
+};
+
 struct vulkan_kernel {
 	VkDescriptorSetLayout set_layout;
 	VkPipelineLayout pipeline_layout;
 	VkPipeline pipeline;
 	VkShaderModule shader;
+
+	/* layout of the set, used to write cached descriptor sets */
+	const VkDescriptorSetLayoutBinding *bindings;
+	uint32_t binding_count;
+
+	/* shape the pipeline was built with; with more than one element per
+	 * invocation the shader loads pairs, and fewer groups are dispatched */
+	uint32_t local_size;
+	uint32_t elements_per_invocation;
+
+	/* the pipeline's shape with single element loads, for buffers at
+	 * offsets pairs can't be loaded from; built on first use */
+	VkPipeline scalar_pipeline;
+
+	/* set once the objects above exist; read without the kernel lock */
+	bool ready;
+	/* only ever prepended to, under the kernel lock, so records can walk
+	 * the list without it */
+	struct vulkan_kernel_variant *variants;
+	/* set once a plan records pipeline or scalar_pipeline, so a new shape
+	 * retires them instead of destroying them */
+	bool recorded;
+	/* destroyed once no plan is left, under the kernel lock */
+	struct vulkan_retired_pipeline *retired;
 };
 
 enum vulkan_kernel_type {
@@ -22,38 +69,223 @@ enum vulkan_kernel_type {
 	VULKAN_KERNEL_TYPE_NTTREVBUTTERFLY	= 5,
 	VULKAN_KERNEL_TYPE_ELEMMULCONST		= 6,
 	VULKAN_KERNEL_TYPE_ELEMMODBYTWO		= 7,
+	VULKAN_KERNEL_TYPE_NTTFWDFUSED		= 8,
+	VULKAN_KERNEL_TYPE_NTTREVFUSED		= 9,
 	VULKAN_KERNEL_TYPE_MAX,
 };
 
+enum vulkan_queue_type {
+	VULKAN_QUEUE_TYPE_COMPUTE	= 0,
+	VULKAN_QUEUE_TYPE_TRANSFER	= 1,
+	VULKAN_QUEUE_TYPE_MAX,
+};
+
+#define VULKAN_MAX_COMPUTE_QUEUES 8
+
+struct vulkan_queue {
+	enum vulkan_queue_type type;
+	uint32_t family_index;
+	VkQueue queue;
+
+	/* points at another queue's lock when both use the same VkQueue */
+	pthread_mutex_t lock;
+	pthread_mutex_t *submit_lock;
+};
+
+struct vulkan_cmd_pool {
+	VkCommandPool cmd_pool;
+
+	/* command buffers of finished executions, kept for reuse instead of
+	 * being freed; they are implicitly reset when begun again. executions
+	 * can finish on any thread, so the list has its own lock */
+	pthread_mutex_t lock;
+	VkCommandBuffer *free_cmd_buffers;
+	size_t free_cmd_buffer_count;
+	size_t free_cmd_buffer_capacity;
+};
+
+/* command pools are externally synchronized, so every thread records into
+ * its own; the state of an exited thread is handed to the next new one */
+struct vulkan_thread {
+	struct vulkan_thread *next;
+	struct vulkan_thread *next_idle;
+	struct vulkan_ctx *vk;
+
+	/* compute queues are handed out round robin as threads show up, so
+	 * the submissions of one thread stay in order */
+	struct vulkan_queue *queues[VULKAN_QUEUE_TYPE_MAX];
+	struct vulkan_cmd_pool cmd_pools[VULKAN_QUEUE_TYPE_MAX];
+};
+
 struct vulkan_execution {
-	VkDescriptorPool descriptor_pool;
+	struct vulkan_queue *queue;
+	struct vulkan_cmd_pool *cmd_pool;
 	VkCommandBuffer cmd_buffer;
+	/* recorded once and submitted many times, by an NTT plan */
+	bool prerecorded;
 };
 
 struct vulkan_ctx {
 	VkInstance instance;
 	VkPhysicalDevice physical_device;
 	VkDevice device;
+	/* number of suitable devices on the instance */
+	uint32_t device_count;
+	/* maxComputeWorkGroupCount[0]; kernels stride over larger inputs */
+	uint32_t max_group_count;
+	/* kernels bind a whole vector as one storage buffer */
+	uint32_t max_storage_buffer_range;
+	/* vector views must start at a multiple of it */
+	VkDeviceSize min_storage_buffer_offset_alignment;
 
-	uint32_t queue_family_index;
-	VkQueue queue;
+	/* kernels run on the compute queue and copies on the transfer queue;
+	 * without a second queue on the device both use the same VkQueue */
+	struct vulkan_queue compute_queues[VULKAN_MAX_COMPUTE_QUEUES];
+	uint32_t compute_queue_count;
+	uint32_t next_compute_queue;
+	struct vulkan_queue transfer;
+	/* device buffers are shared concurrently when the families differ */
+	bool transfer_concurrent;
+
+	/* guards the thread lists and the free fences */
+	pthread_mutex_t lock;
+	pthread_key_t thread_key;
+	struct vulkan_thread *threads;
+	struct vulkan_thread *idle_threads;
 
 	VkPhysicalDeviceMemoryProperties memory_properties;
 	uint32_t host_visible_memory_index;
 	uint32_t device_local_memory_index;
+	/* vectors live in host visible memory and are mapped in place */
+	bool unified_memory;
 	VmaAllocator mem_allocator;
+	/* VK_NULL_HANDLE when disabled in the options */
+	VkPipelineCache pipeline_cache;
+	/* owned copy of the options path, NULL if the cache is not saved */
+	char *pipeline_cache_path;
 
-	VkCommandPool cmd_pool;
+	/* descriptors are pushed into the command buffer instead of being
+	 * taken from the descriptor cache when VK_KHR_push_descriptor is
+	 * available */
+	bool push_descriptor;
+	PFN_vkCmdPushDescriptorSetKHR cmd_push_descriptor_set;
+
+	/* fences of finished executions, already reset for reuse */
+	VkFence *free_fences;
+	size_t free_fence_count;
+	size_t free_fence_capacity;
+
+	struct descriptor_cache descriptor_cache;
+	/* host transfers of vectors stream through it */
+	struct staging_ring staging;
+
+	/* kernels are created on first use, or ahead of it by a prewarm;
+	 * the lock serializes their creation */
+	pthread_mutex_t kernel_lock;
 	struct vulkan_kernel kernels[VULKAN_KERNEL_TYPE_MAX];
+	/* tuned shapes, 0 where the shader's own size and a single element
+	 * per invocation are used */
+	uint32_t local_sizes[VULKAN_KERNEL_TYPE_MAX];
+	uint32_t elements_per_invocation[VULKAN_KERNEL_TYPE_MAX];
+	/* live NTT plans, under the kernel lock; retired pipelines are kept
+	 * while there are any */
+	uint32_t plan_count;
+	/* identifies the device in tuning files */
+	uint8_t device_uuid[VK_UUID_SIZE];
+	/* background prewarm, joined before the next one and at finish */
+	pthread_mutex_t prewarm_lock;
+	pthread_t prewarm_thread;
+	bool prewarming;
+	uint32_t prewarm_kernels;
 };
 
-struct vulkan_ctx *vulkan_ctx_init(struct vulkan_ctx *ini);
+/* opens the device picked by the options, or returns NULL if none match */
+struct vulkan_ctx *vulkan_ctx_init(struct vulkan_ctx *ini,
+		const struct vkhel_ctx_options *options);
 void vulkan_ctx_finish(struct vulkan_ctx *ctx);
+/* workgroups of local_size to dispatch for the invocations, capped at the
+ * device limit; the shaders loop over whatever doesn't fit */
+uint32_t vulkan_ctx_group_count(const struct vulkan_ctx *vk,
+		uint64_t invocations, uint32_t local_size);
+/* returns the kernel, creating its pipeline if this is its first use */
+struct vulkan_kernel *vulkan_ctx_kernel(struct vulkan_ctx *vk,
+		enum vulkan_kernel_type type);
+/* builds the kernel's pipeline with the tuned shape, or with the shader's
+ * own size if there is none; for shaders that take the size and pair
+ * loads as specialization constants 0 and 4 */
+VkResult vulkan_kernel_create_pipeline(struct vulkan_ctx *vk,
+		enum vulkan_kernel_type type, uint32_t shader_local_size);
+/* rebuilds a tunable kernel and its variants with a new shape; no work
+ * using the kernel may be in flight, but pipelines live plans recorded
+ * are kept */
+void vulkan_ctx_set_kernel_shape(struct vulkan_ctx *vk,
+		enum vulkan_kernel_type type, uint32_t local_size,
+		uint32_t elements_per_invocation);
+/* counts a plan in and out; the last one out frees retired pipelines */
+void vulkan_ctx_plan_acquire(struct vulkan_ctx *vk);
+void vulkan_ctx_plan_release(struct vulkan_ctx *vk);
+/* builds variants of the modular kernels for mod; local_size 0 keeps the
+ * workgroup size of the kernels, and follows it when it is retuned */
+void vulkan_ctx_specialize(struct vulkan_ctx *vk, uint64_t mod,
+		uint32_t local_size);
+/* the variant dispatched for mod: the newest one built for it in the
+ * kernel's current elements per invocation and, unless its own was
+ * asked for, local size; NULL if there is none */
+const struct vulkan_kernel_variant *vulkan_kernel_find_variant(
+		const struct vulkan_kernel *kernel, uint64_t mod);
+/* binds the kernel's variant for mod, or its generic pipeline, and
+ * dispatches enough groups for length elements; kernels without a
+ * modulus pass 0, which never has a variant. pairs can only be loaded
+ * from buffers bound at 16 byte offsets, with others the kernel's scalar
+ * pipeline is used */
+void vulkan_kernel_dispatch(struct vulkan_ctx *vk,
+		struct vulkan_kernel *kernel, struct vulkan_execution *execution,
+		const VkDescriptorBufferInfo *buffers, size_t buffer_count,
+		uint64_t mod, uint64_t length);
+/* true if pairs can be loaded from every buffer */
+bool vulkan_kernel_pair_aligned(const VkDescriptorBufferInfo *buffers,
+		size_t buffer_count);
+/* the kernel's pipeline with single element loads, built on first use */
+VkPipeline vulkan_kernel_scalar_pipeline(struct vulkan_ctx *vk,
+		struct vulkan_kernel *kernel);
+/* creates the kernels whose bit (1 << type) is set in the mask, either
+ * right away or on a background thread */
+void vulkan_ctx_prewarm(struct vulkan_ctx *vk, uint32_t kernels,
+		bool background);
+VkResult vulkan_ctx_create_set_layout(struct vulkan_ctx *vk,
+		const VkDescriptorSetLayoutCreateInfo *create_info,
+		VkDescriptorSetLayout *set_layout);
+uint32_t vulkan_kernel_fill_writes(const struct vulkan_kernel *kernel,
+		VkDescriptorSet set, const VkDescriptorBufferInfo *buffers,
+		size_t buffer_count, VkWriteDescriptorSet *writes);
+void vulkan_kernel_bind_buffers(struct vulkan_ctx *vk,
+		const struct vulkan_kernel *kernel,
+		struct vulkan_execution *execution,
+		const VkDescriptorBufferInfo *buffers, size_t buffer_count);
 void vulkan_ctx_create_fence(struct vulkan_ctx *vk, VkFence *fence,
 		bool signaled);
+VkFence vulkan_ctx_acquire_fence(struct vulkan_ctx *vk);
+void vulkan_ctx_release_fence(struct vulkan_ctx *vk, VkFence fence);
 void vulkan_ctx_execution_begin(struct vulkan_ctx *vk,
-		struct vulkan_execution *execution, size_t set_count);
+		struct vulkan_execution *execution, enum vulkan_queue_type type);
+/* the queue of the given type used by the calling thread */
+struct vulkan_queue *vulkan_ctx_queue(struct vulkan_ctx *vk,
+		enum vulkan_queue_type type);
+/* submits to the queue while holding its lock */
+VkResult vulkan_queue_submit(struct vulkan_queue *queue,
+		const VkSubmitInfo *submit_info, VkFence fence);
+void vulkan_ctx_execution_barrier(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution);
+/* makes the device writes recorded so far visible to host reads */
+void vulkan_ctx_execution_host_barrier(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution);
+/* records a host barrier, then ends and submits the execution */
 void vulkan_ctx_execution_end(struct vulkan_ctx *vk,
 		struct vulkan_execution *execution, VkFence fence);
+void vulkan_ctx_execution_finish(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution);
+/* ends, submits and waits for the execution, then finishes it */
+void vulkan_ctx_execution_submit_wait(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution);
 
 #endif
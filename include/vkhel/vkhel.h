@@ -5,10 +5,131 @@
 #include <stddef.h>
 #include <stdint.h>
 
+enum vkhel_device_type {
+	VKHEL_DEVICE_TYPE_ANY			= 0,
+	VKHEL_DEVICE_TYPE_DISCRETE_GPU	= 1,
+	VKHEL_DEVICE_TYPE_INTEGRATED_GPU	= 2,
+	VKHEL_DEVICE_TYPE_VIRTUAL_GPU	= 3,
+	VKHEL_DEVICE_TYPE_CPU			= 4,
+};
+
+struct vkhel_ctx_options {
+	/* index among the suitable devices, or -1 to pick the best ranked
+	 * device (discrete, integrated, virtual, cpu) matching the name and
+	 * type below */
+	int32_t device_index;
+	/* substring of the device name, or NULL for any */
+	const char *device_name;
+	enum vkhel_device_type device_type;
+
+	/* compute queues that threads are spread over, capped by the device */
+	uint32_t queue_count;
+	bool pipeline_cache;
+	/* push descriptors into command buffers when the device supports
+	 * VK_KHR_push_descriptor, instead of caching descriptor sets */
+	bool push_descriptors;
+	/* file the pipeline cache is loaded from at creation and written back
+	 * to at destruction, or NULL to keep it in memory only; a file made
+	 * for another device or driver is ignored */
+	const char *pipeline_cache_path;
+	/* bytes that may be allocated from each memory heap, 0 for no limit */
+	uint64_t memory_budget;
+	/* on devices whose device local memory is host cached, as integrated
+	 * GPUs and CPU implementations, vectors are allocated host visible
+	 * and mapped in place; false stages every host access through a copy
+	 * instead */
+	bool host_visible_vectors;
+	/* file written by vkhel_ctx_autotune, or NULL to use the default
+	 * workgroup sizes; entries for other devices are ignored */
+	const char *tuning_path;
+	/* buffers of destroyed vectors are kept for new vectors of the same
+	 * power of two size class, up to this many bytes in total and this
+	 * many per class. pooled buffers are rounded up to their class size,
+	 * those of classes above pool_bytes are not; 0 bytes, the default,
+	 * frees them right away */
+	uint64_t pool_bytes;
+	uint32_t pool_buffers_per_class;
+};
+
+/* kernels are compiled on their first use; these bits name them for
+ * vkhel_ctx_prewarm */
+enum vkhel_kernel {
+	VKHEL_KERNEL_ELEMFMA			= 1 << 0,
+	VKHEL_KERNEL_ELEMMUL			= 1 << 1,
+	VKHEL_KERNEL_ELEMGTADD			= 1 << 2,
+	VKHEL_KERNEL_ELEMGTSUB			= 1 << 3,
+	VKHEL_KERNEL_NTTFWDBUTTERFLY	= 1 << 4,
+	VKHEL_KERNEL_NTTREVBUTTERFLY	= 1 << 5,
+	VKHEL_KERNEL_ELEMMULCONST		= 1 << 6,
+	VKHEL_KERNEL_ELEMMODBYTWO		= 1 << 7,
+	VKHEL_KERNEL_NTTFWDFUSED		= 1 << 8,
+	VKHEL_KERNEL_NTTREVFUSED		= 1 << 9,
+	/* everything the transforms use */
+	VKHEL_KERNEL_NTT				= VKHEL_KERNEL_NTTFWDBUTTERFLY
+		| VKHEL_KERNEL_NTTREVBUTTERFLY | VKHEL_KERNEL_ELEMMULCONST
+		| VKHEL_KERNEL_NTTFWDFUSED | VKHEL_KERNEL_NTTREVFUSED,
+	VKHEL_KERNEL_ALL				= (1 << 10) - 1,
+};
+
+/* what a mapping is used for, so only the needed transfers are made */
+enum vkhel_map_mode {
+	/* the contents are read, changes are not written back */
+	VKHEL_MAP_READ			= 0,
+	/* the range is overwritten, its previous contents are undefined */
+	VKHEL_MAP_WRITE_DISCARD	= 1,
+	VKHEL_MAP_READ_WRITE	= 2,
+};
+
 struct vkhel_ctx;
+void vkhel_ctx_options_init(struct vkhel_ctx_options *);
 struct vkhel_ctx *vkhel_ctx_create();
+/* NULL if no suitable device matches the options */
+struct vkhel_ctx *vkhel_ctx_create_with_options(
+		const struct vkhel_ctx_options *);
+/* NULL if there is no suitable device with that index */
+struct vkhel_ctx *vkhel_ctx_create_on_device(uint32_t index);
 void vkhel_ctx_destroy(struct vkhel_ctx *);
+/* frees pooled vector buffers until at most keep_bytes are kept */
+void vkhel_ctx_trim(struct vkhel_ctx *, uint64_t keep_bytes);
+/* builds pipelines of the modular kernels with mod, and local_size if it
+ * is not 0, compiled in as constants; later operations modulo mod use
+ * the last ones built for it, rebuilt in the new shape when the kernels
+ * are tuned. meant for services that work with a handful of fixed
+ * primes */
+void vkhel_ctx_specialize(struct vkhel_ctx *, uint64_t mod,
+		uint32_t local_size);
+/* benchmarks the elementwise kernels at several workgroup sizes and
+ * elements per invocation, keeps the fastest for this context and, if
+ * path isn't NULL, records them in the tuning file under this device;
+ * false if the file can't be written. nothing else may run on the
+ * context meanwhile. NTT plans made before keep the shapes they were
+ * recorded with; the pipelines they use are freed once no plan is left
+ * on the context */
+bool vkhel_ctx_autotune(struct vkhel_ctx *, const char *path);
+/* compiles the kernels in the mask now instead of on first use */
+void vkhel_ctx_prewarm(struct vkhel_ctx *, uint32_t kernels);
+/* same, on a background thread; an operation that needs a kernel still
+ * being compiled waits for it */
+void vkhel_ctx_prewarm_async(struct vkhel_ctx *, uint32_t kernels);
+
+/* a context per suitable device; vectors are placed on a device by
+ * creating them on its context */
+struct vkhel_multi_ctx;
+typedef void (*vkhel_shard_fn)(struct vkhel_ctx *, size_t index, void *data);
+struct vkhel_multi_ctx *vkhel_multi_ctx_create();
+void vkhel_multi_ctx_destroy(struct vkhel_multi_ctx *);
+size_t vkhel_multi_ctx_device_count(const struct vkhel_multi_ctx *);
+struct vkhel_ctx *vkhel_multi_ctx_device(struct vkhel_multi_ctx *,
+		size_t index);
+/* runs fn for every index in [0, count), with index i on device
+ * i % device_count; devices run their jobs concurrently, and this returns
+ * once all of them are done */
+void vkhel_multi_ctx_shard(struct vkhel_multi_ctx *, size_t count,
+		vkhel_shard_fn fn, void *data);
 
+/* tables can be shared by threads and contexts; they are copied to each
+ * context on first use there, and must be destroyed before those
+ * contexts */
 struct vkhel_ntt_tables;
 struct vkhel_ntt_tables *vkhel_ntt_tables_create(
 		uint64_t n, uint64_t q, uint64_t w);
@@ -19,9 +140,27 @@ struct vkhel_vector *vkhel_vector_create(struct vkhel_ctx *, uint64_t length);
 struct vkhel_vector *vkhel_vector_create2(struct vkhel_ctx *, uint64_t length,
 		bool zero);
 void vkhel_vector_destroy(struct vkhel_vector *);
+/* a vector aliasing length elements of the parent, starting at offset; it
+ * is accepted wherever a vector is, and must be destroyed before the
+ * parent. offset * 8 must be a multiple of the device's
+ * minStorageBufferOffsetAlignment. like any vector it must no longer be
+ * in use when destroyed, and neither may other views of the same range */
+struct vkhel_vector *vkhel_vector_view(struct vkhel_vector *parent,
+		uint64_t offset, uint64_t length);
 struct vkhel_vector *vkhel_vector_dup(struct vkhel_vector *);
 void vkhel_vector_copy_from_host(struct vkhel_vector *, const uint64_t *);
+void vkhel_vector_copy_to_host(const struct vkhel_vector *, uint64_t *);
+/* copy count vectors of one context at once, with their contents in
+ * separate host arrays; small vectors share submissions */
+void vkhel_vectors_copy_from_host_many(struct vkhel_vector *const *vectors,
+		const uint64_t *const *src, size_t count);
+void vkhel_vectors_copy_to_host_many(const struct vkhel_vector *const *vectors,
+		uint64_t *const *dst, size_t count);
+/* maps the first size bytes for reading and writing */
 void vkhel_vector_map(struct vkhel_vector *, void **, size_t);
+/* maps size bytes starting offset bytes into the vector */
+void *vkhel_vector_map_range(struct vkhel_vector *, size_t offset,
+		size_t size, enum vkhel_map_mode mode);
 void vkhel_vector_unmap(struct vkhel_vector *);
 
 void vkhel_vector_elemfma(
@@ -52,4 +191,88 @@ void vkhel_vector_inverse_transform(
 		struct vkhel_vector *result,
 		struct vkhel_ntt_tables *ntt);
 
+/* non-blocking variants of the ops above; the returned event has to be
+ * waited on before the result is mapped or copied, and waiting frees it */
+struct vkhel_event;
+bool vkhel_event_poll(const struct vkhel_event *);
+void vkhel_event_wait(struct vkhel_event *);
+void vkhel_event_wait_all(struct vkhel_event **, size_t count);
+struct vkhel_event *vkhel_vector_elemfma_async(
+		const struct vkhel_vector *a,
+		const struct vkhel_vector *b,
+		struct vkhel_vector *result,
+		uint64_t multiplier, uint64_t mod);
+struct vkhel_event *vkhel_vector_elemmod_async(
+		const struct vkhel_vector *a,
+		struct vkhel_vector *result, uint64_t mod, uint64_t q);
+struct vkhel_event *vkhel_vector_elemmul_async(
+		const struct vkhel_vector *a,
+		const struct vkhel_vector *b,
+		struct vkhel_vector *result, uint64_t mod);
+struct vkhel_event *vkhel_vector_elemgtadd_async(
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		uint64_t bound, uint64_t diff);
+struct vkhel_event *vkhel_vector_elemgtsub_async(
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		uint64_t bound, uint64_t diff, uint64_t mod);
+struct vkhel_event *vkhel_vector_forward_transform_async(
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		struct vkhel_ntt_tables *ntt);
+struct vkhel_event *vkhel_vector_inverse_transform_async(
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		struct vkhel_ntt_tables *ntt);
+
+/* deferred ops, recorded into a single command buffer with barriers only
+ * between dependent ops; submit blocks until they are done and frees the
+ * batch */
+struct vkhel_batch;
+struct vkhel_batch *vkhel_batch_begin(struct vkhel_ctx *);
+void vkhel_batch_submit(struct vkhel_batch *);
+struct vkhel_event *vkhel_batch_submit_async(struct vkhel_batch *);
+void vkhel_batch_elemfma(struct vkhel_batch *,
+		const struct vkhel_vector *a,
+		const struct vkhel_vector *b,
+		struct vkhel_vector *result,
+		uint64_t multiplier, uint64_t mod);
+void vkhel_batch_elemmod(struct vkhel_batch *,
+		const struct vkhel_vector *a,
+		struct vkhel_vector *result, uint64_t mod, uint64_t q);
+void vkhel_batch_elemmul(struct vkhel_batch *,
+		const struct vkhel_vector *a,
+		const struct vkhel_vector *b,
+		struct vkhel_vector *result, uint64_t mod);
+void vkhel_batch_elemgtadd(struct vkhel_batch *,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		uint64_t bound, uint64_t diff);
+void vkhel_batch_elemgtsub(struct vkhel_batch *,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		uint64_t bound, uint64_t diff, uint64_t mod);
+void vkhel_batch_forward_transform(struct vkhel_batch *,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		struct vkhel_ntt_tables *ntt);
+void vkhel_batch_inverse_transform(struct vkhel_batch *,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		struct vkhel_ntt_tables *ntt);
+
+/* pre-recorded transforms of operand into result; the tables and vectors
+ * must outlive the plan. the plan reads the tables' copy on its own
+ * context, using the tables on other contexts doesn't affect it. runs of
+ * one plan from several threads are serialized, each waits for the one
+ * before it */
+struct vkhel_ntt_plan;
+struct vkhel_ntt_plan *vkhel_ntt_plan_create(struct vkhel_ntt_tables *ntt,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result);
+void vkhel_ntt_plan_destroy(struct vkhel_ntt_plan *);
+void vkhel_ntt_plan_forward(struct vkhel_ntt_plan *);
+void vkhel_ntt_plan_inverse(struct vkhel_ntt_plan *);
+
 #endif
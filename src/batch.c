@@ -0,0 +1,282 @@
+#include <assert.h>
+#include <stdlib.h>
+#include "priv/batch.h"
+#include "priv/event.h"
+#include "priv/kernels/elemfma.h"
+#include "priv/kernels/elemmodbytwo.h"
+#include "priv/kernels/elemmul.h"
+#include "priv/kernels/elemgtadd.h"
+#include "priv/kernels/elemgtsub.h"
+#include "priv/ntt_tables.h"
+#include "priv/vkhel.h"
+#include "priv/vector.h"
+
+/* buffer ranges accessed since the last barrier in the command buffer */
+struct batch_hazards {
+	VkDescriptorBufferInfo *reads;
+	size_t read_count;
+	VkDescriptorBufferInfo *writes;
+	size_t write_count;
+};
+
+static struct batch_op *batch_push(struct vkhel_batch *batch,
+		enum batch_op_type type, struct vkhel_vector *result) {
+	assert(result->ctx == batch->ctx);
+
+	if (batch->op_count == batch->op_capacity) {
+		batch->op_capacity = batch->op_capacity == 0
+			? 8 : batch->op_capacity * 2;
+		batch->ops = realloc(batch->ops,
+				batch->op_capacity * sizeof(struct batch_op));
+		assert(batch->ops != NULL);
+	}
+
+	struct batch_op *op = &batch->ops[batch->op_count++];
+	*op = (struct batch_op) {
+		.type = type,
+		.result = result,
+	};
+	return op;
+}
+
+static void batch_op_record(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution, const struct batch_op *op) {
+	switch (op->type) {
+		case BATCH_OP_TYPE_ELEMFMA:
+			vulkan_kernel_elemfma_record(vk,
+					vulkan_ctx_kernel(vk, VULKAN_KERNEL_TYPE_ELEMFMA),
+					execution, op->result, op->operands[0], op->operands[1],
+					op->elemfma.multiplier, op->elemfma.mod);
+			return;
+		case BATCH_OP_TYPE_ELEMMOD:
+			if (op->elemmod.mod == 2) {
+				vulkan_kernel_elemmodbytwo_record(vk,
+						vulkan_ctx_kernel(vk, VULKAN_KERNEL_TYPE_ELEMMODBYTWO),
+						execution, op->result, op->operands[0],
+						op->elemmod.q / 2);
+			} else {
+				vulkan_kernel_elemgtsub_record(vk,
+						vulkan_ctx_kernel(vk, VULKAN_KERNEL_TYPE_ELEMGTSUB),
+						execution, op->result, op->operands[0],
+						op->elemmod.q / 2, op->elemmod.q, op->elemmod.mod);
+			}
+			return;
+		case BATCH_OP_TYPE_ELEMMUL:
+			vulkan_kernel_elemmul_record(vk,
+					vulkan_ctx_kernel(vk, VULKAN_KERNEL_TYPE_ELEMMUL),
+					execution, op->result, op->operands[0], op->operands[1],
+					op->elemmul.mod);
+			return;
+		case BATCH_OP_TYPE_ELEMGTADD:
+			vulkan_kernel_elemgtadd_record(vk,
+					vulkan_ctx_kernel(vk, VULKAN_KERNEL_TYPE_ELEMGTADD),
+					execution, op->result, op->operands[0],
+					op->elemgtadd.bound, op->elemgtadd.diff);
+			return;
+		case BATCH_OP_TYPE_ELEMGTSUB:
+			vulkan_kernel_elemgtsub_record(vk,
+					vulkan_ctx_kernel(vk, VULKAN_KERNEL_TYPE_ELEMGTSUB),
+					execution, op->result, op->operands[0],
+					op->elemgtsub.bound, op->elemgtsub.diff,
+					op->elemgtsub.mod);
+			return;
+		case BATCH_OP_TYPE_FORWARD_TRANSFORM:
+			vkhel_vector_record_forward_transform(vk, execution,
+					op->operands[0], op->result, op->ntt);
+			return;
+		case BATCH_OP_TYPE_INVERSE_TRANSFORM:
+			vkhel_vector_record_inverse_transform(vk, execution,
+					op->operands[0], op->result, op->ntt);
+			return;
+	}
+	assert(false);
+}
+
+/* views of one vector only conflict where their ranges overlap */
+static bool overlaps_range(const VkDescriptorBufferInfo *ranges,
+		size_t count, const VkDescriptorBufferInfo *range) {
+	for (size_t i = 0; i < count; i++) {
+		if (ranges[i].buffer == range->buffer
+				&& ranges[i].offset < range->offset + range->range
+				&& range->offset < ranges[i].offset + ranges[i].range) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* an op has to wait for earlier ones if it reads what they wrote (RAW) or
+ * writes what they read or wrote (WAR, WAW) */
+static bool batch_op_has_hazard(const struct batch_hazards *hazards,
+		const struct batch_op *op) {
+	for (size_t i = 0; i < BATCH_OP_MAX_OPERANDS; i++) {
+		if (op->operands[i] == NULL) {
+			continue;
+		}
+		const VkDescriptorBufferInfo operand =
+			vkhel_vector_buffer_info(op->operands[i]);
+		if (overlaps_range(hazards->writes, hazards->write_count, &operand)) {
+			return true;
+		}
+	}
+
+	const VkDescriptorBufferInfo result =
+		vkhel_vector_buffer_info(op->result);
+	return overlaps_range(hazards->reads, hazards->read_count, &result)
+		|| overlaps_range(hazards->writes, hazards->write_count, &result);
+}
+
+static void batch_hazards_add(struct batch_hazards *hazards,
+		const struct batch_op *op) {
+	for (size_t i = 0; i < BATCH_OP_MAX_OPERANDS; i++) {
+		if (op->operands[i] != NULL) {
+			hazards->reads[hazards->read_count++] =
+				vkhel_vector_buffer_info(op->operands[i]);
+		}
+	}
+	hazards->writes[hazards->write_count++] =
+		vkhel_vector_buffer_info(op->result);
+}
+
+struct vkhel_batch *vkhel_batch_begin(struct vkhel_ctx *ctx) {
+	struct vkhel_batch *ini = calloc(1, sizeof(struct vkhel_batch));
+	ini->ctx = ctx;
+	return ini;
+}
+
+void vkhel_batch_elemfma(struct vkhel_batch *batch,
+		const struct vkhel_vector *a,
+		const struct vkhel_vector *b,
+		struct vkhel_vector *result,
+		uint64_t multiplier, uint64_t mod) {
+	assert(a->ctx == b->ctx && b->ctx == result->ctx);
+	struct batch_op *op = batch_push(batch, BATCH_OP_TYPE_ELEMFMA, result);
+	op->operands[0] = a;
+	op->operands[1] = b;
+	op->elemfma.multiplier = multiplier;
+	op->elemfma.mod = mod;
+}
+
+void vkhel_batch_elemmod(struct vkhel_batch *batch,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result, uint64_t mod, uint64_t q) {
+	assert(operand->ctx == result->ctx);
+	struct batch_op *op = batch_push(batch, BATCH_OP_TYPE_ELEMMOD, result);
+	op->operands[0] = operand;
+	op->elemmod.mod = mod;
+	op->elemmod.q = q;
+}
+
+void vkhel_batch_elemmul(struct vkhel_batch *batch,
+		const struct vkhel_vector *a,
+		const struct vkhel_vector *b,
+		struct vkhel_vector *result, uint64_t mod) {
+	assert(a->ctx == b->ctx && b->ctx == result->ctx);
+	struct batch_op *op = batch_push(batch, BATCH_OP_TYPE_ELEMMUL, result);
+	op->operands[0] = a;
+	op->operands[1] = b;
+	op->elemmul.mod = mod;
+}
+
+void vkhel_batch_elemgtadd(struct vkhel_batch *batch,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		uint64_t bound, uint64_t diff) {
+	assert(operand->ctx == result->ctx);
+	struct batch_op *op = batch_push(batch, BATCH_OP_TYPE_ELEMGTADD, result);
+	op->operands[0] = operand;
+	op->elemgtadd.bound = bound;
+	op->elemgtadd.diff = diff;
+}
+
+void vkhel_batch_elemgtsub(struct vkhel_batch *batch,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		uint64_t bound, uint64_t diff, uint64_t mod) {
+	assert(operand->ctx == result->ctx);
+	struct batch_op *op = batch_push(batch, BATCH_OP_TYPE_ELEMGTSUB, result);
+	op->operands[0] = operand;
+	op->elemgtsub.bound = bound;
+	op->elemgtsub.diff = diff;
+	op->elemgtsub.mod = mod;
+}
+
+void vkhel_batch_forward_transform(struct vkhel_batch *batch,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		struct vkhel_ntt_tables *ntt) {
+	assert(operand->ctx == result->ctx);
+	struct batch_op *op = batch_push(batch,
+			BATCH_OP_TYPE_FORWARD_TRANSFORM, result);
+	op->operands[0] = operand;
+	op->ntt = ntt;
+}
+
+void vkhel_batch_inverse_transform(struct vkhel_batch *batch,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		struct vkhel_ntt_tables *ntt) {
+	assert(operand->ctx == result->ctx);
+	struct batch_op *op = batch_push(batch,
+			BATCH_OP_TYPE_INVERSE_TRANSFORM, result);
+	op->operands[0] = operand;
+	op->ntt = ntt;
+}
+
+struct vkhel_event *vkhel_batch_submit_async(struct vkhel_batch *batch) {
+	struct vkhel_ctx *ctx = batch->ctx;
+
+	if (batch->op_count == 0) {
+		free(batch);
+		return NULL;
+	}
+
+	/* uploads wait on their own submission, so they have to happen before
+	 * recording starts */
+	for (size_t i = 0; i < batch->op_count; i++) {
+		const struct batch_op *op = &batch->ops[i];
+		if (op->type == BATCH_OP_TYPE_FORWARD_TRANSFORM
+				|| op->type == BATCH_OP_TYPE_INVERSE_TRANSFORM) {
+			vkhel_ntt_tables_upload(op->ntt, ctx);
+		}
+	}
+
+	struct batch_hazards hazards = {
+		.reads = calloc(BATCH_OP_MAX_OPERANDS * batch->op_count,
+				sizeof(VkDescriptorBufferInfo)),
+		.writes = calloc(batch->op_count, sizeof(VkDescriptorBufferInfo)),
+	};
+
+	struct vkhel_event *event = vkhel_event_create(ctx);
+	struct vulkan_execution *execution = &event->execution;
+	vulkan_ctx_execution_begin(&ctx->vk, execution,
+			VULKAN_QUEUE_TYPE_COMPUTE);
+
+	/* earlier submissions may still be running and touching our buffers */
+	vulkan_ctx_execution_barrier(&ctx->vk, execution);
+
+	for (size_t i = 0; i < batch->op_count; i++) {
+		const struct batch_op *op = &batch->ops[i];
+
+		if (batch_op_has_hazard(&hazards, op)) {
+			vulkan_ctx_execution_barrier(&ctx->vk, execution);
+			hazards.read_count = 0;
+			hazards.write_count = 0;
+		}
+		batch_hazards_add(&hazards, op);
+
+		batch_op_record(&ctx->vk, execution, op);
+	}
+	vulkan_ctx_execution_end(&ctx->vk, execution, event->fence);
+
+	free(hazards.reads);
+	free(hazards.writes);
+	free(batch->ops);
+	free(batch);
+
+	return event;
+}
+
+void vkhel_batch_submit(struct vkhel_batch *batch) {
+	vkhel_event_wait(vkhel_batch_submit_async(batch));
+}
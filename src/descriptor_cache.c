@@ -0,0 +1,214 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "priv/descriptor_cache.h"
+#include "priv/vulkan.h"
+
+static size_t hash_key(const struct vulkan_kernel *kernel,
+		const VkDescriptorBufferInfo *buffers, size_t buffer_count) {
+	/* FNV-1a over the handles, offsets and ranges */
+	uint64_t hash = 0xcbf29ce484222325;
+	hash = (hash ^ (uint64_t) (uintptr_t) kernel) * 0x100000001b3;
+	for (size_t i = 0; i < buffer_count; i++) {
+		hash = (hash ^ (uint64_t) (uintptr_t) buffers[i].buffer)
+			* 0x100000001b3;
+		hash = (hash ^ buffers[i].offset) * 0x100000001b3;
+		hash = (hash ^ buffers[i].range) * 0x100000001b3;
+	}
+	return hash % DESCRIPTOR_CACHE_BUCKET_COUNT;
+}
+
+static bool entry_matches(const struct descriptor_cache_entry *entry,
+		const struct vulkan_kernel *kernel,
+		const VkDescriptorBufferInfo *buffers, size_t buffer_count) {
+	if (entry->kernel != kernel || entry->buffer_count != buffer_count) {
+		return false;
+	}
+
+	for (size_t i = 0; i < buffer_count; i++) {
+		if (entry->buffers[i].buffer != buffers[i].buffer
+				|| entry->buffers[i].offset != buffers[i].offset
+				|| entry->buffers[i].range != buffers[i].range) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static void add_pool(struct vulkan_ctx *vk, struct descriptor_cache *cache) {
+	VkDescriptorPoolCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+		.maxSets = DESCRIPTOR_CACHE_POOL_SETS,
+		.poolSizeCount = 1,
+		.pPoolSizes = &(const VkDescriptorPoolSize) {
+			.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = DESCRIPTOR_CACHE_MAX_BUFFERS
+				* DESCRIPTOR_CACHE_POOL_SETS,
+		},
+	};
+
+	cache->pools = realloc(cache->pools,
+			(cache->pool_count + 1) * sizeof(struct descriptor_cache_pool));
+	assert(cache->pools != NULL);
+
+	struct descriptor_cache_pool *pool = &cache->pools[cache->pool_count];
+	VkResult res = vkCreateDescriptorPool(vk->device, &create_info, NULL,
+			&pool->pool);
+	assert(res == VK_SUCCESS);
+	pool->free_sets = DESCRIPTOR_CACHE_POOL_SETS;
+	cache->pool_count++;
+}
+
+static bool try_allocate_set(struct vulkan_ctx *vk,
+		struct descriptor_cache_pool *pool,
+		const struct vulkan_kernel *kernel, VkDescriptorSet *set) {
+	VkDescriptorSetAllocateInfo allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = pool->pool,
+		.descriptorSetCount = 1,
+		.pSetLayouts = &kernel->set_layout,
+	};
+	VkResult res = vkAllocateDescriptorSets(vk->device, &allocate_info, set);
+	if (res == VK_ERROR_OUT_OF_POOL_MEMORY
+			|| res == VK_ERROR_FRAGMENTED_POOL) {
+		return false;
+	}
+	assert(res == VK_SUCCESS);
+	pool->free_sets--;
+	return true;
+}
+
+static VkDescriptorSet allocate_set(struct vulkan_ctx *vk,
+		struct descriptor_cache *cache, const struct vulkan_kernel *kernel,
+		size_t *pool_index) {
+	VkDescriptorSet set;
+	for (size_t i = cache->pool_count; i-- > 0;) {
+		if (cache->pools[i].free_sets > 0
+				&& try_allocate_set(vk, &cache->pools[i], kernel, &set)) {
+			*pool_index = i;
+			return set;
+		}
+	}
+
+	add_pool(vk, cache);
+	*pool_index = cache->pool_count - 1;
+	bool allocated = try_allocate_set(vk, &cache->pools[*pool_index],
+			kernel, &set);
+	assert(allocated);
+	return set;
+}
+
+void descriptor_cache_init(struct vulkan_ctx *vk) {
+	pthread_mutex_init(&vk->descriptor_cache.lock, NULL);
+}
+
+VkDescriptorSet descriptor_cache_get(struct vulkan_ctx *vk,
+		const struct vulkan_kernel *kernel,
+		const VkDescriptorBufferInfo *buffers, size_t buffer_count) {
+	struct descriptor_cache *cache = &vk->descriptor_cache;
+	assert(buffer_count <= DESCRIPTOR_CACHE_MAX_BUFFERS);
+
+	const size_t bucket = hash_key(kernel, buffers, buffer_count);
+	pthread_mutex_lock(&cache->lock);
+	for (struct descriptor_cache_entry *entry = cache->buckets[bucket];
+			entry != NULL; entry = entry->next) {
+		if (entry_matches(entry, kernel, buffers, buffer_count)) {
+			pthread_mutex_unlock(&cache->lock);
+			return entry->set;
+		}
+	}
+
+	struct descriptor_cache_entry *entry =
+		calloc(1, sizeof(struct descriptor_cache_entry));
+	entry->kernel = kernel;
+	entry->buffer_count = buffer_count;
+	memcpy(entry->buffers, buffers,
+			buffer_count * sizeof(VkDescriptorBufferInfo));
+	entry->set = allocate_set(vk, cache, kernel, &entry->pool_index);
+
+	VkWriteDescriptorSet writes[DESCRIPTOR_CACHE_MAX_BUFFERS];
+	const uint32_t write_count = vulkan_kernel_fill_writes(kernel,
+			entry->set, buffers, buffer_count, writes);
+	vkUpdateDescriptorSets(vk->device, write_count, writes, 0, NULL);
+
+	entry->next = cache->buckets[bucket];
+	cache->buckets[bucket] = entry;
+	cache->entry_count++;
+	pthread_mutex_unlock(&cache->lock);
+	return entry->set;
+}
+
+/* with a range, only bindings of exactly that range count */
+static bool entry_references(const struct descriptor_cache_entry *entry,
+		VkBuffer buffer, const VkDescriptorBufferInfo *range) {
+	for (size_t i = 0; i < entry->buffer_count; i++) {
+		if (entry->buffers[i].buffer == buffer && (range == NULL
+					|| (entry->buffers[i].offset == range->offset
+						&& entry->buffers[i].range == range->range))) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void invalidate(struct vulkan_ctx *vk, VkBuffer buffer,
+		const VkDescriptorBufferInfo *range) {
+	struct descriptor_cache *cache = &vk->descriptor_cache;
+
+	pthread_mutex_lock(&cache->lock);
+	for (size_t i = 0; i < DESCRIPTOR_CACHE_BUCKET_COUNT; i++) {
+		struct descriptor_cache_entry **link = &cache->buckets[i];
+		while (*link != NULL) {
+			struct descriptor_cache_entry *entry = *link;
+			if (!entry_references(entry, buffer, range)) {
+				link = &entry->next;
+				continue;
+			}
+
+			*link = entry->next;
+			struct descriptor_cache_pool *pool =
+				&cache->pools[entry->pool_index];
+			vkFreeDescriptorSets(vk->device, pool->pool, 1, &entry->set);
+			pool->free_sets++;
+			free(entry);
+			cache->entry_count--;
+		}
+	}
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void descriptor_cache_invalidate(struct vulkan_ctx *vk, VkBuffer buffer) {
+	invalidate(vk, buffer, NULL);
+}
+
+void descriptor_cache_invalidate_range(struct vulkan_ctx *vk,
+		const VkDescriptorBufferInfo *range) {
+	invalidate(vk, range->buffer, range);
+}
+
+void descriptor_cache_finish(struct vulkan_ctx *vk) {
+	struct descriptor_cache *cache = &vk->descriptor_cache;
+
+	for (size_t i = 0; i < DESCRIPTOR_CACHE_BUCKET_COUNT; i++) {
+		struct descriptor_cache_entry *entry = cache->buckets[i];
+		while (entry != NULL) {
+			struct descriptor_cache_entry *next = entry->next;
+			free(entry);
+			entry = next;
+		}
+		cache->buckets[i] = NULL;
+	}
+	cache->entry_count = 0;
+
+	/* destroying the pools frees the sets */
+	for (size_t i = 0; i < cache->pool_count; i++) {
+		vkDestroyDescriptorPool(vk->device, cache->pools[i].pool, NULL);
+	}
+	free(cache->pools);
+	cache->pools = NULL;
+	cache->pool_count = 0;
+
+	pthread_mutex_destroy(&cache->lock);
+}
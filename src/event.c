@@ -0,0 +1,42 @@
+#include <assert.h>
+#include <stdlib.h>
+#include "priv/event.h"
+#include "priv/vkhel.h"
+
+struct vkhel_event *vkhel_event_create(struct vkhel_ctx *ctx) {
+	struct vkhel_event *ini = calloc(1, sizeof(struct vkhel_event));
+	ini->ctx = ctx;
+	ini->fence = vulkan_ctx_acquire_fence(&ctx->vk);
+	return ini;
+}
+
+bool vkhel_event_poll(const struct vkhel_event *event) {
+	if (event == NULL) {
+		return true;
+	}
+
+	VkResult res = vkGetFenceStatus(event->ctx->vk.device, event->fence);
+	assert(res == VK_SUCCESS || res == VK_NOT_READY);
+	return res == VK_SUCCESS;
+}
+
+void vkhel_event_wait(struct vkhel_event *event) {
+	if (event == NULL) {
+		return;
+	}
+
+	struct vulkan_ctx *vk = &event->ctx->vk;
+
+	VkResult res = vkWaitForFences(vk->device, 1, &event->fence, true, -1);
+	assert(res == VK_SUCCESS);
+
+	vulkan_ctx_execution_finish(vk, &event->execution);
+	vulkan_ctx_release_fence(vk, event->fence);
+	free(event);
+}
+
+void vkhel_event_wait_all(struct vkhel_event **events, size_t count) {
+	for (size_t i = 0; i < count; i++) {
+		vkhel_event_wait(events[i]);
+	}
+}
@@ -54,9 +54,11 @@ void vulkan_kernel_elemmodbytwo_init(struct vulkan_ctx *vk) {
 			&ini->shader);
 	assert(res == VK_SUCCESS);
 
-	res = vkCreateDescriptorSetLayout(vk->device, &descriptor_set_create_info,
-			NULL, &ini->set_layout);
+	res = vulkan_ctx_create_set_layout(vk, &descriptor_set_create_info,
+			&ini->set_layout);
 	assert(res == VK_SUCCESS);
+	ini->bindings = descriptor_bindings;
+	ini->binding_count = descriptor_set_create_info.bindingCount;
 
 	VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
@@ -69,20 +71,8 @@ void vulkan_kernel_elemmodbytwo_init(struct vulkan_ctx *vk) {
 			NULL, &ini->pipeline_layout);
 	assert(res == VK_SUCCESS);
 
-	VkComputePipelineCreateInfo pipeline_create_info = {
-		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
-		.pNext = NULL,
-		.flags = 0,
-		.stage = {
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
-			.module = ini->shader,
-			.pName = "main",
-		},
-		.layout = ini->pipeline_layout,
-	};
-	res = vkCreateComputePipelines(vk->device, NULL, 1, &pipeline_create_info,
-			NULL, &ini->pipeline);
+	res = vulkan_kernel_create_pipeline(vk, VULKAN_KERNEL_TYPE_ELEMMODBYTWO,
+			SHADER_LOCAL_SIZE_X);
 	assert(res == VK_SUCCESS);
 }
 
@@ -93,60 +83,13 @@ void vulkan_kernel_elemmodbytwo_record(
 		struct vkhel_vector *result,
 		const struct vkhel_vector *operand,
 		uint64_t signed_bound) {
-	VkResult res = VK_ERROR_UNKNOWN;
-
-	VkDescriptorSet descriptor_set;
-	VkDescriptorSetAllocateInfo descriptor_allocate_info = {
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-		.descriptorPool = execution->descriptor_pool,
-		.descriptorSetCount = 1,
-		.pSetLayouts = &kernel->set_layout,
-	};
-	res = vkAllocateDescriptorSets(vk->device, &descriptor_allocate_info, 
-			&descriptor_set);
-	assert(res == VK_SUCCESS);
-
-	const VkWriteDescriptorSet write_descriptor_sets[] = {
-		{
-			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-			.dstSet = descriptor_set,
-			.dstBinding = 0,
-			.dstArrayElement = 0,
-			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			.descriptorCount = 1,
-			.pBufferInfo = (const VkDescriptorBufferInfo[]) {
-				{
-					.buffer = operand->device.buffer,
-					.offset = 0,
-					.range = operand->length * sizeof(uint64_t),
-				},
-			},
-		},
-		{
-			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-			.dstSet = descriptor_set,
-			.dstBinding = 1,
-			.dstArrayElement = 0,
-			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			.descriptorCount = 1,
-			.pBufferInfo = (const VkDescriptorBufferInfo[]) {
-				{
-					.buffer = result->device.buffer,
-					.offset = 0,
-					.range = result->length * sizeof(uint64_t),
-				},
-			},
-		},
+	const VkDescriptorBufferInfo buffer_infos[] = {
+		vkhel_vector_buffer_info(operand),
+		vkhel_vector_buffer_info(result),
 	};
-	vkUpdateDescriptorSets(vk->device,
-			sizeof(write_descriptor_sets) / sizeof(VkWriteDescriptorSet),
-			write_descriptor_sets, 0, NULL);
 
-	vkCmdBindPipeline(execution->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
-			kernel->pipeline);
-	vkCmdBindDescriptorSets(execution->cmd_buffer,
-			VK_PIPELINE_BIND_POINT_COMPUTE,
-			kernel->pipeline_layout, 0, 1, &descriptor_set, 0, NULL);
+	vulkan_kernel_bind_buffers(vk, kernel, execution, buffer_infos,
+			sizeof(buffer_infos) / sizeof(VkDescriptorBufferInfo));
 
 	const struct push_constants push = {
 		.length = result->length,
@@ -156,6 +99,7 @@ void vulkan_kernel_elemmodbytwo_record(
 			VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(struct push_constants),
 			&push);
 
-	vkCmdDispatch(execution->cmd_buffer,
-			DIV_CEIL(result->length, SHADER_LOCAL_SIZE_X), 1, 1);
+	vulkan_kernel_dispatch(vk, kernel, execution, buffer_infos,
+			sizeof(buffer_infos) / sizeof(VkDescriptorBufferInfo),
+			0, result->length);
 }
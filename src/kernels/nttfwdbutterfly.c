@@ -7,9 +7,9 @@
 #define SHADER_LOCAL_SIZE_X 64
 
 struct push_constants {
+	uint64_t butterflies;
 	uint64_t transform_size;
-	uint64_t twiddle_factor;
-	uint64_t barrett_factor; /* barrett factor for multiplying by twiddle */
+	uint64_t root_offset; /* index of the stage's first twiddle factor */
 	uint64_t mod;
 };
 
@@ -38,6 +38,20 @@ static const VkDescriptorSetLayoutBinding descriptor_bindings[] = {
 		.descriptorCount = 1,
 		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
 	},
+	/* twiddle factors */
+	{
+		.binding = 2,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+	},
+	/* barrett factors of the twiddle factors */
+	{
+		.binding = 3,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+	},
 };
 
 static const VkDescriptorSetLayoutCreateInfo descriptor_set_create_info = {
@@ -55,9 +69,11 @@ void vulkan_kernel_nttfwdbutterfly_init(struct vulkan_ctx *vk) {
 			&ini->shader);
 	assert(res == VK_SUCCESS);
 
-	res = vkCreateDescriptorSetLayout(vk->device, &descriptor_set_create_info,
-			NULL, &ini->set_layout);
+	res = vulkan_ctx_create_set_layout(vk, &descriptor_set_create_info,
+			&ini->set_layout);
 	assert(res == VK_SUCCESS);
+	ini->bindings = descriptor_bindings;
+	ini->binding_count = descriptor_set_create_info.bindingCount;
 
 	VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
@@ -82,8 +98,8 @@ void vulkan_kernel_nttfwdbutterfly_init(struct vulkan_ctx *vk) {
 		},
 		.layout = ini->pipeline_layout,
 	};
-	res = vkCreateComputePipelines(vk->device, NULL, 1, &pipeline_create_info,
-			NULL, &ini->pipeline);
+	res = vkCreateComputePipelines(vk->device, vk->pipeline_cache, 1,
+			&pipeline_create_info, NULL, &ini->pipeline);
 	assert(res == VK_SUCCESS);
 }
 
@@ -92,76 +108,35 @@ void vulkan_kernel_nttfwdbutterfly_record(
 		struct vulkan_kernel *kernel,
 		struct vulkan_execution *execution,
 		struct vkhel_ntt_tables *ntt,
-		uint64_t mod, uint64_t power,
-		uint64_t transform_size, uint64_t offset,
+		uint64_t root_offset, uint64_t transform_size,
 		const struct vkhel_vector *operand,
 		struct vkhel_vector *result) {
-	VkResult res = VK_ERROR_UNKNOWN;
-
-	VkDescriptorSet descriptor_set;
-	VkDescriptorSetAllocateInfo descriptor_allocate_info = {
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-		.descriptorPool = execution->descriptor_pool,
-		.descriptorSetCount = 1,
-		.pSetLayouts = &kernel->set_layout,
-	};
-	res = vkAllocateDescriptorSets(vk->device, &descriptor_allocate_info, 
-			&descriptor_set);
-	assert(res == VK_SUCCESS);
-
-	const VkWriteDescriptorSet write_descriptor_sets[] = {
-		{
-			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-			.dstSet = descriptor_set,
-			.dstBinding = 0,
-			.dstArrayElement = 0,
-			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			.descriptorCount = 1,
-			.pBufferInfo = (const VkDescriptorBufferInfo[]) {
-				{
-					.buffer = operand->device.buffer,
-					.offset = offset * sizeof(uint64_t),
-					.range = 2 * transform_size * sizeof(uint64_t),
-				},
-			},
-		},
-		{
-			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-			.dstSet = descriptor_set,
-			.dstBinding = 1,
-			.dstArrayElement = 0,
-			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			.descriptorCount = 1,
-			.pBufferInfo = (const VkDescriptorBufferInfo[]) {
-				{
-					.buffer = result->device.buffer,
-					.offset = offset * sizeof(uint64_t),
-					.range = 2 * transform_size * sizeof(uint64_t),
-				},
-			},
-		},
+	const struct ntt_device_tables *tables =
+		vkhel_ntt_tables_device(ntt, result->ctx);
+	const VkDescriptorBufferInfo buffer_infos[] = {
+		vkhel_vector_buffer_info(operand),
+		vkhel_vector_buffer_info(result),
+		vkhel_vector_buffer_info(tables->roots_of_unity),
+		vkhel_vector_buffer_info(tables->roots_barrett_factors),
 	};
-	vkUpdateDescriptorSets(vk->device,
-			sizeof(write_descriptor_sets) / sizeof(VkWriteDescriptorSet),
-			write_descriptor_sets, 0, NULL);
 
 	vkCmdBindPipeline(execution->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
 			kernel->pipeline);
-	vkCmdBindDescriptorSets(execution->cmd_buffer,
-			VK_PIPELINE_BIND_POINT_COMPUTE,
-			kernel->pipeline_layout, 0, 1, &descriptor_set, 0, NULL);
+	vulkan_kernel_bind_buffers(vk, kernel, execution, buffer_infos,
+			sizeof(buffer_infos) / sizeof(VkDescriptorBufferInfo));
 
 	const struct push_constants push = {
+		.butterflies = ntt->n / 2,
 		.transform_size = transform_size,
-		.twiddle_factor = ntt->roots_of_unity[power],
-		.barrett_factor = ntt->roots_barrett_factors[power],
-		.mod = mod,
+		.root_offset = root_offset,
+		.mod = ntt->q,
 	};
 	vkCmdPushConstants(execution->cmd_buffer, kernel->pipeline_layout,
 			VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(struct push_constants),
 			&push);
 
 	vkCmdDispatch(execution->cmd_buffer,
-			DIV_CEIL(transform_size, SHADER_LOCAL_SIZE_X), 1, 1);
+			vulkan_ctx_group_count(vk, ntt->n / 2, SHADER_LOCAL_SIZE_X),
+			1, 1);
 }
 
@@ -0,0 +1,141 @@
+#include <assert.h>
+#include "priv/vkhel.h"
+#include "priv/kernels/nttrevfused.h"
+#include "priv/ntt_tables.h"
+#include "nttrevfused.comp.h"
+
+struct push_constants {
+	uint64_t length;
+	uint64_t transform_size; /* half the block transformed by a workgroup */
+	uint64_t mod;
+};
+
+static const VkPushConstantRange push_constants_range = {
+	.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+	.offset = 0,
+	.size = sizeof(struct push_constants),
+};
+
+static const VkShaderModuleCreateInfo shader_module_create_info = {
+	.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+	.pCode = nttrevfused_comp_data,
+	.codeSize = sizeof(nttrevfused_comp_data),
+};
+
+static const VkDescriptorSetLayoutBinding descriptor_bindings[] = {
+	{
+		.binding = 0,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+	},
+	{
+		.binding = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+	},
+	/* twiddle factors */
+	{
+		.binding = 2,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+	},
+	/* barrett factors of the twiddle factors */
+	{
+		.binding = 3,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		.descriptorCount = 1,
+		.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+	},
+};
+
+static const VkDescriptorSetLayoutCreateInfo descriptor_set_create_info = {
+	.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+	.bindingCount = sizeof(descriptor_bindings) 
+		/ sizeof(VkDescriptorSetLayoutBinding),
+	.pBindings = descriptor_bindings,
+};
+
+void vulkan_kernel_nttrevfused_init(struct vulkan_ctx *vk) {
+	struct vulkan_kernel *ini = &vk->kernels[VULKAN_KERNEL_TYPE_NTTREVFUSED];
+	VkResult res = VK_ERROR_UNKNOWN;
+
+	res = vkCreateShaderModule(vk->device, &shader_module_create_info, NULL,
+			&ini->shader);
+	assert(res == VK_SUCCESS);
+
+	res = vulkan_ctx_create_set_layout(vk, &descriptor_set_create_info,
+			&ini->set_layout);
+	assert(res == VK_SUCCESS);
+	ini->bindings = descriptor_bindings;
+	ini->binding_count = descriptor_set_create_info.bindingCount;
+
+	VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+		.setLayoutCount = 1,
+		.pSetLayouts = &ini->set_layout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &push_constants_range,
+	};
+	res = vkCreatePipelineLayout(vk->device, &pipeline_layout_create_info,
+			NULL, &ini->pipeline_layout);
+	assert(res == VK_SUCCESS);
+
+	VkComputePipelineCreateInfo pipeline_create_info = {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.pNext = NULL,
+		.flags = 0,
+		.stage = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = ini->shader,
+			.pName = "main",
+		},
+		.layout = ini->pipeline_layout,
+	};
+	res = vkCreateComputePipelines(vk->device, vk->pipeline_cache, 1,
+			&pipeline_create_info, NULL, &ini->pipeline);
+	assert(res == VK_SUCCESS);
+}
+
+void vulkan_kernel_nttrevfused_record(
+		struct vulkan_ctx *vk,
+		struct vulkan_kernel *kernel,
+		struct vulkan_execution *execution,
+		struct vkhel_ntt_tables *ntt,
+		uint64_t transform_size,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result) {
+	const struct ntt_device_tables *tables =
+		vkhel_ntt_tables_device(ntt, result->ctx);
+	const VkDescriptorBufferInfo buffer_infos[] = {
+		vkhel_vector_buffer_info(operand),
+		vkhel_vector_buffer_info(result),
+		vkhel_vector_buffer_info(tables->inv_roots_of_unity),
+		vkhel_vector_buffer_info(tables->inv_roots_barrett_factors),
+	};
+
+	vkCmdBindPipeline(execution->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+			kernel->pipeline);
+	vulkan_kernel_bind_buffers(vk, kernel, execution, buffer_infos,
+			sizeof(buffer_infos) / sizeof(VkDescriptorBufferInfo));
+
+	assert(transform_size <= NTTREVFUSED_MAX_TRANSFORM_SIZE);
+
+	const struct push_constants push = {
+		.length = ntt->n,
+		.transform_size = transform_size,
+		.mod = ntt->q,
+	};
+	vkCmdPushConstants(execution->cmd_buffer, kernel->pipeline_layout,
+			VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(struct push_constants),
+			&push);
+
+	/* one workgroup per block of 2 * transform_size elements */
+	vkCmdDispatch(execution->cmd_buffer,
+			vulkan_ctx_group_count(vk, ntt->n / (2 * transform_size), 1),
+			1, 1);
+}
+
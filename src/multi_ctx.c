@@ -0,0 +1,87 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include "priv/multi_ctx.h"
+#include "priv/vkhel.h"
+
+struct shard_worker {
+	struct vkhel_multi_ctx *multi;
+	size_t device;
+	size_t count;
+	vkhel_shard_fn fn;
+	void *data;
+};
+
+static void *shard_worker_run(void *data) {
+	const struct shard_worker *worker = data;
+	struct vkhel_ctx *ctx = worker->multi->devices[worker->device];
+
+	for (size_t i = worker->device; i < worker->count;
+			i += worker->multi->device_count) {
+		worker->fn(ctx, i, worker->data);
+	}
+	return NULL;
+}
+
+struct vkhel_multi_ctx *vkhel_multi_ctx_create() {
+	struct vkhel_ctx *first = vkhel_ctx_create_on_device(0);
+	assert(first != NULL);
+
+	struct vkhel_multi_ctx *ini = calloc(1, sizeof(struct vkhel_multi_ctx));
+	ini->device_count = first->vk.device_count;
+	ini->devices = calloc(ini->device_count, sizeof(struct vkhel_ctx *));
+	ini->devices[0] = first;
+	for (size_t i = 1; i < ini->device_count; i++) {
+		ini->devices[i] = vkhel_ctx_create_on_device(i);
+		assert(ini->devices[i] != NULL);
+	}
+
+	return ini;
+}
+
+void vkhel_multi_ctx_destroy(struct vkhel_multi_ctx *multi) {
+	for (size_t i = 0; i < multi->device_count; i++) {
+		vkhel_ctx_destroy(multi->devices[i]);
+	}
+	free(multi->devices);
+	free(multi);
+}
+
+size_t vkhel_multi_ctx_device_count(const struct vkhel_multi_ctx *multi) {
+	return multi->device_count;
+}
+
+struct vkhel_ctx *vkhel_multi_ctx_device(struct vkhel_multi_ctx *multi,
+		size_t index) {
+	assert(index < multi->device_count);
+	return multi->devices[index];
+}
+
+void vkhel_multi_ctx_shard(struct vkhel_multi_ctx *multi, size_t count,
+		vkhel_shard_fn fn, void *data) {
+	/* every device works through its share of the jobs on its own thread,
+	 * contexts are safe to use from any thread */
+	pthread_t *threads = calloc(multi->device_count, sizeof(pthread_t));
+	struct shard_worker *workers =
+		calloc(multi->device_count, sizeof(struct shard_worker));
+
+	for (size_t i = 0; i < multi->device_count; i++) {
+		workers[i] = (struct shard_worker) {
+			.multi = multi,
+			.device = i,
+			.count = count,
+			.fn = fn,
+			.data = data,
+		};
+		int err = pthread_create(&threads[i], NULL, shard_worker_run,
+				&workers[i]);
+		assert(err == 0);
+	}
+
+	for (size_t i = 0; i < multi->device_count; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	free(threads);
+	free(workers);
+}
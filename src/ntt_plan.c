@@ -0,0 +1,148 @@
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "priv/ntt_plan.h"
+#include "priv/ntt_tables.h"
+#include "priv/vkhel.h"
+#include "priv/vector.h"
+
+typedef void (*ntt_plan_record_fn)(struct vulkan_ctx *,
+		struct vulkan_execution *,
+		const struct vkhel_vector *, struct vkhel_vector *,
+		struct vkhel_ntt_tables *);
+static const ntt_plan_record_fn ntt_plan_records[NTT_PLAN_DIRECTION_MAX] = {
+	[NTT_PLAN_DIRECTION_FORWARD] = vkhel_vector_record_forward_transform,
+	[NTT_PLAN_DIRECTION_INVERSE] = vkhel_vector_record_inverse_transform,
+};
+
+static void record_plan(struct vkhel_ntt_plan *plan,
+		enum ntt_plan_direction direction) {
+	struct vulkan_ctx *vk = &plan->ctx->vk;
+	VkResult res = VK_ERROR_UNKNOWN;
+
+	struct vulkan_execution execution = {
+		.cmd_buffer = plan->cmd_buffers[direction],
+		.prerecorded = true,
+	};
+
+	/* no ONE_TIME_SUBMIT, the command buffer is submitted on every run */
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = 0,
+	};
+	res = vkBeginCommandBuffer(execution.cmd_buffer, &begin_info);
+	assert(res == VK_SUCCESS);
+
+	/* asynchronous ops submitted before a run may still be in flight */
+	vulkan_ctx_execution_barrier(vk, &execution);
+
+	ntt_plan_records[direction](vk, &execution, plan->operand, plan->result,
+			plan->ntt);
+
+	vulkan_ctx_execution_host_barrier(vk, &execution);
+
+	res = vkEndCommandBuffer(execution.cmd_buffer);
+	assert(res == VK_SUCCESS);
+}
+
+static void run_plan(struct vkhel_ntt_plan *plan,
+		enum ntt_plan_direction direction) {
+	struct vulkan_ctx *vk = &plan->ctx->vk;
+	VkResult res = VK_ERROR_UNKNOWN;
+
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &plan->cmd_buffers[direction],
+	};
+	pthread_mutex_lock(&plan->run_lock);
+	res = vulkan_queue_submit(vulkan_ctx_queue(vk, VULKAN_QUEUE_TYPE_COMPUTE),
+			&submit_info, plan->fence);
+	assert(res == VK_SUCCESS);
+
+	vkWaitForFences(vk->device, 1, &plan->fence, true, -1);
+	vkResetFences(vk->device, 1, &plan->fence);
+	pthread_mutex_unlock(&plan->run_lock);
+}
+
+struct vkhel_ntt_plan *vkhel_ntt_plan_create(struct vkhel_ntt_tables *ntt,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result) {
+	assert(operand->ctx == result->ctx);
+	struct vkhel_ctx *ctx = operand->ctx;
+	struct vulkan_ctx *vk = &ctx->vk;
+	VkResult res = VK_ERROR_UNKNOWN;
+
+	struct vkhel_ntt_plan *ini = calloc(1, sizeof(struct vkhel_ntt_plan));
+	ini->ctx = ctx;
+	ini->ntt = ntt;
+	ini->operand = operand;
+	ini->result = result;
+
+	vkhel_ntt_tables_upload(ntt, ctx);
+	vulkan_ctx_plan_acquire(vk);
+
+	VkCommandPoolCreateInfo cmd_pool_create_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = 0,
+		.queueFamilyIndex = vk->compute_queues[0].family_index,
+	};
+	res = vkCreateCommandPool(vk->device, &cmd_pool_create_info, NULL,
+			&ini->cmd_pool);
+	assert(res == VK_SUCCESS);
+
+	VkCommandBufferAllocateInfo cmd_buffer_allocate_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = ini->cmd_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = NTT_PLAN_DIRECTION_MAX,
+	};
+	res = vkAllocateCommandBuffers(vk->device, &cmd_buffer_allocate_info,
+			ini->cmd_buffers);
+	assert(res == VK_SUCCESS);
+
+	for (size_t i = 0; i < NTT_PLAN_DIRECTION_MAX; i++) {
+		record_plan(ini, i);
+	}
+
+	vulkan_ctx_create_fence(vk, &ini->fence, false);
+	pthread_mutex_init(&ini->run_lock, NULL);
+
+	return ini;
+}
+
+void vkhel_ntt_plan_destroy(struct vkhel_ntt_plan *plan) {
+	struct vulkan_ctx *vk = &plan->ctx->vk;
+
+	pthread_mutex_destroy(&plan->run_lock);
+	vkDestroyFence(vk->device, plan->fence, NULL);
+	/* frees the command buffers as well */
+	vkDestroyCommandPool(vk->device, plan->cmd_pool, NULL);
+	vulkan_ctx_plan_release(vk);
+	free(plan);
+}
+
+void vkhel_ntt_plan_forward(struct vkhel_ntt_plan *plan) {
+#ifdef VKHEL_DEBUG
+	printf("planned forward transform ("
+				"degree: %" PRIu64
+				" mod: %" PRIu64
+				" omega: %" PRIu64 ")\n",
+				plan->ntt->n, plan->ntt->q, plan->ntt->w);
+#endif
+
+	run_plan(plan, NTT_PLAN_DIRECTION_FORWARD);
+}
+
+void vkhel_ntt_plan_inverse(struct vkhel_ntt_plan *plan) {
+#ifdef VKHEL_DEBUG
+	printf("planned inverse transform ("
+				"degree: %" PRIu64
+				" mod: %" PRIu64
+				" omega: %" PRIu64 ")\n",
+				plan->ntt->n, plan->ntt->q, plan->ntt->w);
+#endif
+
+	run_plan(plan, NTT_PLAN_DIRECTION_INVERSE);
+}
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include "priv/ntt_tables.h"
 #include "priv/numbers.h"
+#include "priv/vkhel.h"
 
 static uint64_t reverse_bits(uint64_t a, const uint64_t bit_width) {
 	uint64_t rev = 0;
@@ -62,12 +63,67 @@ void vkhel_ntt_tables_dbgprint(struct vkhel_ntt_tables *ntt) {
 	printf("\n");
 }
 
+static struct vkhel_vector *create_device_table(struct vkhel_ctx *ctx,
+		const uint64_t *table, uint64_t n) {
+	/* zero-initialization not required because it is about to be initialized */
+	struct vkhel_vector *vec = vkhel_vector_create2(ctx, n, false);
+	vkhel_vector_copy_from_host(vec, table);
+	return vec;
+}
+
+static struct ntt_device_tables *find_device_tables(
+		const struct vkhel_ntt_tables *ntt, const struct vkhel_ctx *ctx) {
+	for (struct ntt_device_tables *tables = ntt->device_tables;
+			tables != NULL; tables = tables->next) {
+		if (tables->ctx == ctx) {
+			return tables;
+		}
+	}
+	return NULL;
+}
+
+void vkhel_ntt_tables_upload(struct vkhel_ntt_tables *ntt,
+		struct vkhel_ctx *ctx) {
+	pthread_mutex_lock(&ntt->lock);
+	if (find_device_tables(ntt, ctx) != NULL) {
+		pthread_mutex_unlock(&ntt->lock);
+		return;
+	}
+
+	struct ntt_device_tables *tables =
+		calloc(1, sizeof(struct ntt_device_tables));
+	assert(tables != NULL);
+	tables->ctx = ctx;
+	tables->roots_of_unity =
+		create_device_table(ctx, ntt->roots_of_unity, ntt->n);
+	tables->inv_roots_of_unity =
+		create_device_table(ctx, ntt->inv_roots_of_unity, ntt->n);
+	tables->roots_barrett_factors =
+		create_device_table(ctx, ntt->roots_barrett_factors, ntt->n);
+	tables->inv_roots_barrett_factors =
+		create_device_table(ctx, ntt->inv_roots_barrett_factors, ntt->n);
+
+	tables->next = ntt->device_tables;
+	ntt->device_tables = tables;
+	pthread_mutex_unlock(&ntt->lock);
+}
+
+const struct ntt_device_tables *vkhel_ntt_tables_device(
+		struct vkhel_ntt_tables *ntt, const struct vkhel_ctx *ctx) {
+	pthread_mutex_lock(&ntt->lock);
+	const struct ntt_device_tables *tables = find_device_tables(ntt, ctx);
+	pthread_mutex_unlock(&ntt->lock);
+	assert(tables != NULL);
+	return tables;
+}
+
 struct vkhel_ntt_tables *vkhel_ntt_tables_create(uint64_t n,
 		uint64_t q, uint64_t w) {
 	struct vkhel_ntt_tables *ini = calloc(1, sizeof(struct vkhel_ntt_tables));
 	ini->n = n;
 	ini->q = q;
 	ini->w = w;
+	pthread_mutex_init(&ini->lock, NULL);
 
 	ini->roots_of_unity = malloc(sizeof(uint64_t) * n);
 	ini->inv_roots_of_unity = malloc(sizeof(uint64_t) * n);
@@ -80,8 +136,20 @@ struct vkhel_ntt_tables *vkhel_ntt_tables_create(uint64_t n,
 }
 
 void vkhel_ntt_tables_destroy(struct vkhel_ntt_tables *ntt) {
+	while (ntt->device_tables != NULL) {
+		struct ntt_device_tables *tables = ntt->device_tables;
+		ntt->device_tables = tables->next;
+		vkhel_vector_destroy(tables->roots_of_unity);
+		vkhel_vector_destroy(tables->inv_roots_of_unity);
+		vkhel_vector_destroy(tables->roots_barrett_factors);
+		vkhel_vector_destroy(tables->inv_roots_barrett_factors);
+		free(tables);
+	}
+	pthread_mutex_destroy(&ntt->lock);
+
 	free(ntt->roots_of_unity);
 	free(ntt->inv_roots_of_unity);
 	free(ntt->roots_barrett_factors);
 	free(ntt->inv_roots_barrett_factors);
+	free(ntt);
 }
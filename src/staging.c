@@ -0,0 +1,240 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+#include "priv/staging.h"
+#include "priv/vulkan.h"
+
+/* position in the stream of bytes of all copies of a transfer */
+struct staging_cursor {
+	size_t index;
+	VkDeviceSize offset;
+};
+
+struct staging_chunk {
+	struct vulkan_execution execution;
+	VkFence fence;
+	bool pending;
+	/* where the bytes in the chunk came from, or go to */
+	struct staging_cursor start;
+	VkDeviceSize used;
+};
+
+static void ensure_buffer(struct vulkan_ctx *vk, struct staging_ring *ring) {
+	if (ring->mapped != NULL) {
+		return;
+	}
+
+	VkBufferCreateInfo create_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+		.size = STAGING_CHUNK_SIZE * STAGING_CHUNK_COUNT,
+		.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+			| VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+	};
+	VmaAllocationCreateInfo alloc_create_info = {
+		.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST,
+		.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
+			| VMA_ALLOCATION_CREATE_MAPPED_BIT,
+	};
+	VmaAllocationInfo alloc_info;
+	VkResult res = vmaCreateBuffer(vk->mem_allocator, &create_info,
+			&alloc_create_info, &ring->buffer, &ring->allocation, &alloc_info);
+	assert(res == VK_SUCCESS);
+	ring->mapped = alloc_info.pMappedData;
+}
+
+static void cursor_skip_done(struct staging_cursor *cursor,
+		const struct staging_copy *copies, size_t count) {
+	while (cursor->index < count
+			&& cursor->offset == copies[cursor->index].size) {
+		cursor->index++;
+		cursor->offset = 0;
+	}
+}
+
+/* records copies of the bytes at the cursor between the slot's chunk and
+ * the buffers, as many as fit, then submits them; uploads are copied into
+ * the chunk first */
+static void chunk_submit(struct vulkan_ctx *vk, struct staging_ring *ring,
+		struct staging_chunk *chunk, size_t slot,
+		const struct staging_copy *copies, size_t count,
+		struct staging_cursor *cursor, bool upload) {
+	vulkan_ctx_execution_begin(vk, &chunk->execution,
+			VULKAN_QUEUE_TYPE_TRANSFER);
+	chunk->start = *cursor;
+	chunk->used = 0;
+
+	while (cursor->index < count && chunk->used < STAGING_CHUNK_SIZE) {
+		const struct staging_copy *copy = &copies[cursor->index];
+		const VkDeviceSize left = copy->size - cursor->offset;
+		const VkDeviceSize room = STAGING_CHUNK_SIZE - chunk->used;
+		const VkDeviceSize length = left < room ? left : room;
+		const VkDeviceSize ring_offset =
+			slot * STAGING_CHUNK_SIZE + chunk->used;
+
+		if (upload) {
+			memcpy(ring->mapped + ring_offset,
+					(const uint8_t *) copy->host + cursor->offset, length);
+			VkBufferCopy region = {
+				.srcOffset = ring_offset,
+				.dstOffset = copy->offset + cursor->offset,
+				.size = length,
+			};
+			vkCmdCopyBuffer(chunk->execution.cmd_buffer, ring->buffer,
+					copy->buffer, 1, &region);
+		} else {
+			VkBufferCopy region = {
+				.srcOffset = copy->offset + cursor->offset,
+				.dstOffset = ring_offset,
+				.size = length,
+			};
+			vkCmdCopyBuffer(chunk->execution.cmd_buffer, copy->buffer,
+					ring->buffer, 1, &region);
+		}
+
+		chunk->used += length;
+		cursor->offset += length;
+		cursor_skip_done(cursor, copies, count);
+	}
+
+	if (upload) {
+		VkResult res = vmaFlushAllocation(vk->mem_allocator, ring->allocation,
+				slot * STAGING_CHUNK_SIZE, chunk->used);
+		assert(res == VK_SUCCESS);
+	}
+
+	chunk->fence = vulkan_ctx_acquire_fence(vk);
+	vulkan_ctx_execution_end(vk, &chunk->execution, chunk->fence);
+	chunk->pending = true;
+}
+
+/* copies the downloaded bytes out of a completed chunk */
+static void chunk_read(struct vulkan_ctx *vk, struct staging_ring *ring,
+		const struct staging_chunk *chunk, size_t slot,
+		const struct staging_copy *copies, size_t count) {
+	VkResult res = vmaInvalidateAllocation(vk->mem_allocator,
+			ring->allocation, slot * STAGING_CHUNK_SIZE, chunk->used);
+	assert(res == VK_SUCCESS);
+
+	struct staging_cursor cursor = chunk->start;
+	VkDeviceSize done = 0;
+	while (done < chunk->used) {
+		const struct staging_copy *copy = &copies[cursor.index];
+		const VkDeviceSize left = copy->size - cursor.offset;
+		const VkDeviceSize length = left < chunk->used - done
+			? left : chunk->used - done;
+
+		memcpy((uint8_t *) copy->host + cursor.offset,
+				ring->mapped + slot * STAGING_CHUNK_SIZE + done, length);
+
+		done += length;
+		cursor.offset += length;
+		cursor_skip_done(&cursor, copies, count);
+	}
+}
+
+static void chunk_wait(struct vulkan_ctx *vk, struct staging_chunk *chunk) {
+	if (!chunk->pending) {
+		return;
+	}
+
+	VkResult res = vkWaitForFences(vk->device, 1, &chunk->fence, true, -1);
+	assert(res == VK_SUCCESS);
+
+	vulkan_ctx_release_fence(vk, chunk->fence);
+	vulkan_ctx_execution_finish(vk, &chunk->execution);
+	chunk->pending = false;
+}
+
+void staging_ring_init(struct vulkan_ctx *vk) {
+	struct staging_ring *ring = &vk->staging;
+	pthread_mutex_init(&ring->lock, NULL);
+	ring->buffer = VK_NULL_HANDLE;
+	ring->allocation = VK_NULL_HANDLE;
+	ring->mapped = NULL;
+}
+
+void staging_ring_upload_many(struct vulkan_ctx *vk,
+		const struct staging_copy *copies, size_t count) {
+	struct staging_ring *ring = &vk->staging;
+	struct staging_chunk chunks[STAGING_CHUNK_COUNT] = {0};
+
+	pthread_mutex_lock(&ring->lock);
+	ensure_buffer(vk, ring);
+
+	struct staging_cursor cursor = {0};
+	cursor_skip_done(&cursor, copies, count);
+	for (size_t slot = 0; cursor.index < count;
+			slot = (slot + 1) % STAGING_CHUNK_COUNT) {
+		/* the slot is free again once its previous copies completed */
+		chunk_wait(vk, &chunks[slot]);
+		chunk_submit(vk, ring, &chunks[slot], slot, copies, count,
+				&cursor, true);
+	}
+
+	for (size_t i = 0; i < STAGING_CHUNK_COUNT; i++) {
+		chunk_wait(vk, &chunks[i]);
+	}
+	pthread_mutex_unlock(&ring->lock);
+}
+
+void staging_ring_download_many(struct vulkan_ctx *vk,
+		const struct staging_copy *copies, size_t count) {
+	struct staging_ring *ring = &vk->staging;
+	struct staging_chunk chunks[STAGING_CHUNK_COUNT] = {0};
+
+	pthread_mutex_lock(&ring->lock);
+	ensure_buffer(vk, ring);
+
+	/* every slot has copies in flight while the host reads out of the
+	 * oldest one, which is then refilled */
+	struct staging_cursor cursor = {0};
+	cursor_skip_done(&cursor, copies, count);
+	for (size_t slot = 0; slot < STAGING_CHUNK_COUNT && cursor.index < count;
+			slot++) {
+		chunk_submit(vk, ring, &chunks[slot], slot, copies, count,
+				&cursor, false);
+	}
+
+	for (size_t slot = 0; chunks[slot].pending;
+			slot = (slot + 1) % STAGING_CHUNK_COUNT) {
+		chunk_wait(vk, &chunks[slot]);
+		chunk_read(vk, ring, &chunks[slot], slot, copies, count);
+		if (cursor.index < count) {
+			chunk_submit(vk, ring, &chunks[slot], slot, copies, count,
+					&cursor, false);
+		}
+	}
+	pthread_mutex_unlock(&ring->lock);
+}
+
+void staging_ring_upload(struct vulkan_ctx *vk, VkBuffer buffer,
+		VkDeviceSize offset, const void *src, VkDeviceSize size) {
+	const struct staging_copy copy = {
+		.buffer = buffer,
+		.offset = offset,
+		.host = (void *) src,
+		.size = size,
+	};
+	staging_ring_upload_many(vk, &copy, 1);
+}
+
+void staging_ring_download(struct vulkan_ctx *vk, VkBuffer buffer,
+		VkDeviceSize offset, void *dst, VkDeviceSize size) {
+	const struct staging_copy copy = {
+		.buffer = buffer,
+		.offset = offset,
+		.host = dst,
+		.size = size,
+	};
+	staging_ring_download_many(vk, &copy, 1);
+}
+
+void staging_ring_finish(struct vulkan_ctx *vk) {
+	struct staging_ring *ring = &vk->staging;
+	if (ring->mapped != NULL) {
+		vmaDestroyBuffer(vk->mem_allocator, ring->buffer, ring->allocation);
+		ring->mapped = NULL;
+	}
+	pthread_mutex_destroy(&ring->lock);
+}
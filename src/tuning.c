@@ -0,0 +1,290 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "priv/kernels/elemfma.h"
+#include "priv/kernels/elemgtadd.h"
+#include "priv/kernels/elemgtsub.h"
+#include "priv/kernels/elemmodbytwo.h"
+#include "priv/kernels/elemmul.h"
+#include "priv/kernels/elemmulconst.h"
+#include "priv/tuning.h"
+#include "priv/vkhel.h"
+
+#define UUID_STRING_SIZE (2 * VK_UUID_SIZE + 1)
+
+/* kernels whose shaders take their workgroup size as constant 0 */
+static const struct {
+	enum vulkan_kernel_type type;
+	const char *name;
+} tunable_kernels[] = {
+	{ VULKAN_KERNEL_TYPE_ELEMFMA, "elemfma" },
+	{ VULKAN_KERNEL_TYPE_ELEMMUL, "elemmul" },
+	{ VULKAN_KERNEL_TYPE_ELEMGTADD, "elemgtadd" },
+	{ VULKAN_KERNEL_TYPE_ELEMGTSUB, "elemgtsub" },
+	{ VULKAN_KERNEL_TYPE_ELEMMULCONST, "elemmulconst" },
+	{ VULKAN_KERNEL_TYPE_ELEMMODBYTWO, "elemmodbytwo" },
+};
+
+#define TUNABLE_KERNEL_COUNT \
+	(sizeof(tunable_kernels) / sizeof(tunable_kernels[0]))
+
+static const uint32_t candidate_local_sizes[] = {
+	32, 64, 128, 256, 512, 1024,
+};
+
+/* anything above 1 loads pairs */
+static const uint32_t candidate_elements_per_invocation[] = {
+	1, 2, 4, 8,
+};
+
+/* from a single small limb up to a large one */
+static const uint64_t benchmark_lengths[] = {
+	1 << 12, 1 << 16, 1 << 20,
+};
+
+#define BENCHMARK_DISPATCHES 16
+#define BENCHMARK_RUNS 3
+
+/* an arbitrary 61 bit prime, so the reductions do real work */
+#define BENCHMARK_MOD 0x1FFFFFFFFFFFFFFFull
+
+static void uuid_to_string(const uint8_t *uuid, char *string) {
+	for (size_t i = 0; i < VK_UUID_SIZE; i++) {
+		sprintf(&string[2 * i], "%02x", uuid[i]);
+	}
+}
+
+static uint32_t max_local_size(const struct vulkan_ctx *vk) {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vk->physical_device, &properties);
+	const VkPhysicalDeviceLimits *limits = &properties.limits;
+	return limits->maxComputeWorkGroupSize[0]
+		< limits->maxComputeWorkGroupInvocations
+		? limits->maxComputeWorkGroupSize[0]
+		: limits->maxComputeWorkGroupInvocations;
+}
+
+void tuning_load(struct vulkan_ctx *vk, const char *path) {
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		return;
+	}
+
+	char uuid[UUID_STRING_SIZE];
+	uuid_to_string(vk->device_uuid, uuid);
+	const uint32_t max_size = max_local_size(vk);
+
+	char line[256];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char line_uuid[UUID_STRING_SIZE];
+		char name[32];
+		uint32_t local_size;
+		/* files from before elements per invocation was tuned lack it */
+		uint32_t elements_per_invocation = 1;
+		if (sscanf(line, "%32s %31s %u %u", line_uuid, name, &local_size,
+					&elements_per_invocation) < 3
+				|| strcmp(line_uuid, uuid) != 0
+				|| local_size == 0 || local_size > max_size
+				|| elements_per_invocation == 0) {
+			continue;
+		}
+
+		for (size_t i = 0; i < TUNABLE_KERNEL_COUNT; i++) {
+			if (strcmp(name, tunable_kernels[i].name) == 0) {
+				const enum vulkan_kernel_type type = tunable_kernels[i].type;
+				vk->local_sizes[type] = local_size;
+				vk->elements_per_invocation[type] = elements_per_invocation;
+			}
+		}
+	}
+	fclose(file);
+
+#ifdef VKHEL_DEBUG
+	printf("loaded tuning for device %s from %s\n", uuid, path);
+#endif
+}
+
+/* written to a temporary file first so that processes sharing the path
+ * never read a partial file */
+bool tuning_save(const struct vulkan_ctx *vk, const char *path) {
+	char uuid[UUID_STRING_SIZE];
+	uuid_to_string(vk->device_uuid, uuid);
+
+	size_t tmp_path_size = strlen(path) + 32;
+	char *tmp_path = malloc(tmp_path_size);
+	snprintf(tmp_path, tmp_path_size, "%s.%ld.tmp", path, (long) getpid());
+	FILE *out = fopen(tmp_path, "w");
+	if (out == NULL) {
+		free(tmp_path);
+		return false;
+	}
+
+	/* other devices' entries are kept as they are */
+	FILE *in = fopen(path, "r");
+	if (in != NULL) {
+		char line[256];
+		while (fgets(line, sizeof(line), in) != NULL) {
+			if (strncmp(line, uuid, UUID_STRING_SIZE - 1) != 0) {
+				fputs(line, out);
+			}
+		}
+		fclose(in);
+	}
+
+	for (size_t i = 0; i < TUNABLE_KERNEL_COUNT; i++) {
+		const enum vulkan_kernel_type type = tunable_kernels[i].type;
+		if (vk->local_sizes[type] != 0) {
+			fprintf(out, "%s %s %u %u\n", uuid, tunable_kernels[i].name,
+					vk->local_sizes[type],
+					vk->elements_per_invocation[type] != 0
+					? vk->elements_per_invocation[type] : 1);
+		}
+	}
+
+	bool written = fclose(out) == 0 && rename(tmp_path, path) == 0;
+	if (!written) {
+		remove(tmp_path);
+	}
+	free(tmp_path);
+	return written;
+}
+
+static void record_kernel(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution, enum vulkan_kernel_type type,
+		struct vkhel_vector *a, struct vkhel_vector *b,
+		struct vkhel_vector *result) {
+	struct vulkan_kernel *kernel = vulkan_ctx_kernel(vk, type);
+	switch (type) {
+		case VULKAN_KERNEL_TYPE_ELEMFMA:
+			vulkan_kernel_elemfma_record(vk, kernel, execution, result, a, b,
+					3, BENCHMARK_MOD);
+			return;
+		case VULKAN_KERNEL_TYPE_ELEMMUL:
+			vulkan_kernel_elemmul_record(vk, kernel, execution, result, a, b,
+					BENCHMARK_MOD);
+			return;
+		case VULKAN_KERNEL_TYPE_ELEMGTADD:
+			vulkan_kernel_elemgtadd_record(vk, kernel, execution, result, a,
+					BENCHMARK_MOD / 2, 3);
+			return;
+		case VULKAN_KERNEL_TYPE_ELEMGTSUB:
+			vulkan_kernel_elemgtsub_record(vk, kernel, execution, result, a,
+					BENCHMARK_MOD / 2, 3, BENCHMARK_MOD);
+			return;
+		case VULKAN_KERNEL_TYPE_ELEMMULCONST:
+			vulkan_kernel_elemmulconst_record(vk, kernel, execution, result,
+					a, 3, BENCHMARK_MOD);
+			return;
+		case VULKAN_KERNEL_TYPE_ELEMMODBYTWO:
+			vulkan_kernel_elemmodbytwo_record(vk, kernel, execution, result,
+					a, BENCHMARK_MOD / 2);
+			return;
+		default:
+			assert(false);
+	}
+}
+
+static double elapsed_seconds(const struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec)
+		+ (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* best of a few runs of back to back dispatches, in seconds per element
+ * so that every length weighs the same */
+static double benchmark_kernel(struct vkhel_ctx *ctx,
+		enum vulkan_kernel_type type, struct vkhel_vector *a,
+		struct vkhel_vector *b, struct vkhel_vector *result) {
+	struct vulkan_ctx *vk = &ctx->vk;
+	double best = -1;
+	for (size_t run = 0; run < BENCHMARK_RUNS; run++) {
+		struct vulkan_execution execution;
+		vulkan_ctx_execution_begin(vk, &execution, VULKAN_QUEUE_TYPE_COMPUTE);
+		for (size_t i = 0; i < BENCHMARK_DISPATCHES; i++) {
+			if (i > 0) {
+				vulkan_ctx_execution_barrier(vk, &execution);
+			}
+			record_kernel(vk, &execution, type, a, b, result);
+		}
+
+		struct timespec start;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		vulkan_ctx_execution_submit_wait(vk, &execution);
+		const double seconds = elapsed_seconds(&start);
+		if (best < 0 || seconds < best) {
+			best = seconds;
+		}
+	}
+	return best / (BENCHMARK_DISPATCHES * result->length);
+}
+
+double tuning_benchmark(struct vkhel_ctx *ctx, enum vulkan_kernel_type type,
+		uint64_t length) {
+	struct vkhel_vector *a = vkhel_vector_create(ctx, length);
+	struct vkhel_vector *b = vkhel_vector_create(ctx, length);
+	struct vkhel_vector *result = vkhel_vector_create(ctx, length);
+	const double seconds = benchmark_kernel(ctx, type, a, b, result);
+	vkhel_vector_destroy(a);
+	vkhel_vector_destroy(b);
+	vkhel_vector_destroy(result);
+	return seconds;
+}
+
+bool vkhel_ctx_autotune(struct vkhel_ctx *ctx, const char *path) {
+	struct vulkan_ctx *vk = &ctx->vk;
+	const uint32_t max_size = max_local_size(vk);
+
+	const size_t length_count =
+		sizeof(benchmark_lengths) / sizeof(benchmark_lengths[0]);
+	struct vkhel_vector *vectors[3 * length_count];
+	for (size_t i = 0; i < 3 * length_count; i++) {
+		vectors[i] = vkhel_vector_create(ctx, benchmark_lengths[i / 3]);
+	}
+
+	for (size_t i = 0; i < TUNABLE_KERNEL_COUNT; i++) {
+		const enum vulkan_kernel_type type = tunable_kernels[i].type;
+		uint32_t best_size = 0;
+		uint32_t best_elements = 0;
+		double best_score = -1;
+		for (size_t j = 0; j < sizeof(candidate_local_sizes)
+				/ sizeof(candidate_local_sizes[0]); j++) {
+			const uint32_t local_size = candidate_local_sizes[j];
+			if (local_size > max_size) {
+				continue;
+			}
+
+			for (size_t e = 0; e < sizeof(candidate_elements_per_invocation)
+					/ sizeof(candidate_elements_per_invocation[0]); e++) {
+				const uint32_t elements = candidate_elements_per_invocation[e];
+				vulkan_ctx_set_kernel_shape(vk, type, local_size, elements);
+				double score = 0;
+				for (size_t k = 0; k < length_count; k++) {
+					score += benchmark_kernel(ctx, type, vectors[3 * k],
+							vectors[3 * k + 1], vectors[3 * k + 2]);
+				}
+
+#ifdef VKHEL_DEBUG
+				printf("%s with %u invocations, %u elements each: "
+						"%g ns per element\n", tunable_kernels[i].name,
+						local_size, elements, 1e9 * score / length_count);
+#endif
+				if (best_score < 0 || score < best_score) {
+					best_score = score;
+					best_size = local_size;
+					best_elements = elements;
+				}
+			}
+		}
+		vulkan_ctx_set_kernel_shape(vk, type, best_size, best_elements);
+	}
+
+	for (size_t i = 0; i < 3 * length_count; i++) {
+		vkhel_vector_destroy(vectors[i]);
+	}
+
+	return path == NULL || tuning_save(vk, path);
+}
@@ -2,22 +2,19 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
-#include "priv/kernels/elemfma.h"
-#include "priv/kernels/elemmodbytwo.h"
-#include "priv/kernels/elemmul.h"
 #include "priv/kernels/elemmulconst.h"
-#include "priv/kernels/elemgtadd.h"
-#include "priv/kernels/elemgtsub.h"
 #include "priv/kernels/nttfwdbutterfly.h"
+#include "priv/kernels/nttfwdfused.h"
 #include "priv/kernels/nttrevbutterfly.h"
+#include "priv/kernels/nttrevfused.h"
 #include "priv/ntt_tables.h"
 #include "priv/numbers.h"
 #include "priv/vkhel.h"
 #include "priv/vector.h"
+#include "priv/vector_pool.h"
 
 enum backing_memory_usage {
 	BACKING_MEMORY_USAGE_GPU,
-	BACKING_MEMORY_USAGE_TRANSFER,
 	BACKING_MEMORY_USAGE_TRANSFER_SRC,
 	BACKING_MEMORY_USAGE_TRANSFER_DST,
 };
@@ -30,9 +27,6 @@ static VkBufferUsageFlags get_buffer_usage_flags(
 				| VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
 				| VK_BUFFER_USAGE_TRANSFER_SRC_BIT
 				| VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-		case BACKING_MEMORY_USAGE_TRANSFER:
-			return VK_BUFFER_USAGE_TRANSFER_SRC_BIT
-				| VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 		case BACKING_MEMORY_USAGE_TRANSFER_SRC:
 			return VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
 		case BACKING_MEMORY_USAGE_TRANSFER_DST:
@@ -49,7 +43,6 @@ static VmaAllocationCreateFlags get_allocation_create_flags(
 		case BACKING_MEMORY_USAGE_TRANSFER_SRC:
 			return VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
 				| VMA_ALLOCATION_CREATE_MAPPED_BIT;
-		case BACKING_MEMORY_USAGE_TRANSFER:
 		case BACKING_MEMORY_USAGE_TRANSFER_DST:
 			return VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
 				| VMA_ALLOCATION_CREATE_MAPPED_BIT;
@@ -69,14 +62,48 @@ static VkResult allocate_backing_memory(struct vulkan_ctx *vk,
 		.usage = get_buffer_usage_flags(usage),
 		.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 	};
+
+	/* device buffers are written by copies and read by kernels, sharing
+	 * them avoids ownership transfers between the two families */
+	const uint32_t families[] = {
+		vk->compute_queues[0].family_index,
+		vk->transfer.family_index,
+	};
+	if (usage == BACKING_MEMORY_USAGE_GPU && vk->transfer_concurrent) {
+		create_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		create_info.queueFamilyIndexCount = 2;
+		create_info.pQueueFamilyIndices = families;
+	}
 	VmaAllocationCreateInfo alloc_create_info = {
 		.usage = (usage == BACKING_MEMORY_USAGE_GPU 
 				? VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE
 				: VMA_MEMORY_USAGE_AUTO_PREFER_HOST),
 		.flags = get_allocation_create_flags(usage),
 	};
+	VmaAllocationInfo alloc_info;
+	memory->mapped = NULL;
+	memory->size = size;
+
+	/* with unified memory the device copy is the host copy; fall back to
+	 * any device memory if the host visible types are exhausted */
+	if (usage == BACKING_MEMORY_USAGE_GPU && vk->unified_memory) {
+		VmaAllocationCreateInfo uma_create_info = alloc_create_info;
+		uma_create_info.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+			| VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+			| VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+		uma_create_info.flags |= VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT
+			| VMA_ALLOCATION_CREATE_MAPPED_BIT;
+		res = vmaCreateBuffer(vk->mem_allocator, &create_info,
+				&uma_create_info, &memory->buffer, &memory->allocation,
+				&alloc_info);
+		if (res == VK_SUCCESS) {
+			memory->mapped = alloc_info.pMappedData;
+			return res;
+		}
+	}
+
 	res = vmaCreateBuffer(vk->mem_allocator, &create_info, &alloc_create_info,
-			&memory->buffer, &memory->allocation, NULL);
+			&memory->buffer, &memory->allocation, &alloc_info);
 	if (res != VK_SUCCESS) {
 		return res;
 	}
@@ -84,123 +111,32 @@ static VkResult allocate_backing_memory(struct vulkan_ctx *vk,
 	return res;
 }
 
-static void deallocate_backing_memory(struct vulkan_ctx *vk,
-		struct backing_memory *memory) {
-	vmaDestroyBuffer(vk->mem_allocator, memory->buffer, memory->allocation);
-}
-
 static VkResult copy_buffers(struct vulkan_ctx *vk, size_t size,
-		VkBuffer from, VkBuffer to) {
-	VkResult res;
-
-	VkFence fence;
-	vulkan_ctx_create_fence(vk, &fence, false);
-
-	VkCommandBuffer cmd_buffer;
-	VkCommandBufferAllocateInfo allocate_info = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.commandPool = vk->cmd_pool,
-		.commandBufferCount = 1,
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-	};
-	res = vkAllocateCommandBuffers(vk->device, &allocate_info, &cmd_buffer);
-	if (res != VK_SUCCESS) {
-		return res;
-	}
-
-	VkCommandBufferBeginInfo begin_info = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-	};
-	res = vkBeginCommandBuffer(cmd_buffer, &begin_info);
-	if (res != VK_SUCCESS) {
-		return res;
-	}
+		VkBuffer from, VkDeviceSize from_offset,
+		VkBuffer to, VkDeviceSize to_offset) {
+	struct vulkan_execution execution;
+	vulkan_ctx_execution_begin(vk, &execution, VULKAN_QUEUE_TYPE_TRANSFER);
 
 	VkBufferCopy region = {
-		.srcOffset = 0,
-		.dstOffset = 0,
+		.srcOffset = from_offset,
+		.dstOffset = to_offset,
 		.size = size,
 	};
-	vkCmdCopyBuffer(cmd_buffer, from, to, 1, &region);
-
-	res = vkEndCommandBuffer(cmd_buffer);
-	if (res != VK_SUCCESS) {
-		return res;
-	}
-
-	VkSubmitInfo submit = {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &cmd_buffer,
-	};
-	res = vkQueueSubmit(vk->queue, 1, &submit, fence);
-	if (res != VK_SUCCESS) {
-		return res;
-	}
+	vkCmdCopyBuffer(execution.cmd_buffer, from, to, 1, &region);
 
-	vkWaitForFences(vk->device, 1, &fence, true, -1);
-	vkDestroyFence(vk->device, fence, NULL);
-
-	vkFreeCommandBuffers(vk->device, vk->cmd_pool, 1, &cmd_buffer);
-	vkResetCommandPool(vk->device, vk->cmd_pool,
-			VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
-
-	return res;
+	vulkan_ctx_execution_submit_wait(vk, &execution);
+	return VK_SUCCESS;
 }
 
 static VkResult clear_buffer(struct vulkan_ctx *vk, VkBuffer buffer) {
-	VkResult res;
-
-	VkFence fence;
-	vulkan_ctx_create_fence(vk, &fence, false);
-
-	VkCommandBuffer cmd_buffer;
-	VkCommandBufferAllocateInfo allocate_info = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.commandPool = vk->cmd_pool,
-		.commandBufferCount = 1,
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-	};
-	res = vkAllocateCommandBuffers(vk->device, &allocate_info, &cmd_buffer);
-	if (res != VK_SUCCESS) {
-		return res;
-	}
-
-	VkCommandBufferBeginInfo begin_info = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-	};
-	res = vkBeginCommandBuffer(cmd_buffer, &begin_info);
-	if (res != VK_SUCCESS) {
-		return res;
-	}
-
-	vkCmdFillBuffer(cmd_buffer, buffer, 0, VK_WHOLE_SIZE, 0x00000000);
-
-	res = vkEndCommandBuffer(cmd_buffer);
-	if (res != VK_SUCCESS) {
-		return res;
-	}
-
-	VkSubmitInfo submit = {
-		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.commandBufferCount = 1,
-		.pCommandBuffers = &cmd_buffer,
-	};
-	res = vkQueueSubmit(vk->queue, 1, &submit, fence);
-	if (res != VK_SUCCESS) {
-		return res;
-	}
-
-	vkWaitForFences(vk->device, 1, &fence, true, -1);
-	vkDestroyFence(vk->device, fence, NULL);
+	struct vulkan_execution execution;
+	vulkan_ctx_execution_begin(vk, &execution, VULKAN_QUEUE_TYPE_TRANSFER);
 
-	vkFreeCommandBuffers(vk->device, vk->cmd_pool, 1, &cmd_buffer);
-	vkResetCommandPool(vk->device, vk->cmd_pool,
-			VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
+	vkCmdFillBuffer(execution.cmd_buffer, buffer, 0, VK_WHOLE_SIZE,
+			0x00000000);
 
-	return res;
+	vulkan_ctx_execution_submit_wait(vk, &execution);
+	return VK_SUCCESS;
 }
 
 struct vkhel_vector *vkhel_vector_create(struct vkhel_ctx *ctx,
@@ -213,12 +149,23 @@ struct vkhel_vector *vkhel_vector_create2(struct vkhel_ctx *ctx,
 	struct vkhel_vector *ini = calloc(1, sizeof(struct vkhel_vector));
 	ini->ctx = ctx;
 	ini->length = length;
+	assert(length * sizeof(uint64_t) <= ctx->vk.max_storage_buffer_range);
 
 	VkResult res;
 
-	res = allocate_backing_memory(&ctx->vk, BACKING_MEMORY_USAGE_GPU,
-			length * sizeof(uint64_t), &ini->device);
-	assert(res == VK_SUCCESS);
+	const uint64_t size = length * sizeof(uint64_t);
+	if (!vector_pool_take(&ctx->pool, size, &ini->device)) {
+		const uint64_t buffer_size = vector_pool_buffer_size(&ctx->pool, size);
+		res = allocate_backing_memory(&ctx->vk, BACKING_MEMORY_USAGE_GPU,
+				buffer_size, &ini->device);
+		/* pooled buffers of other classes may be what fills the heap */
+		if (res != VK_SUCCESS) {
+			vector_pool_trim(&ctx->vk, &ctx->pool, 0);
+			res = allocate_backing_memory(&ctx->vk, BACKING_MEMORY_USAGE_GPU,
+					buffer_size, &ini->device);
+		}
+		assert(res == VK_SUCCESS);
+	}
 
 	if (zero) {
 		res = clear_buffer(&ctx->vk, ini->device.buffer);
@@ -228,16 +175,53 @@ struct vkhel_vector *vkhel_vector_create2(struct vkhel_ctx *ctx,
 	return ini;
 }
 
+struct vkhel_vector *vkhel_vector_view(struct vkhel_vector *parent,
+		uint64_t offset, uint64_t length) {
+	assert(offset <= parent->length && length <= parent->length - offset);
+
+	/* views of views alias the same buffer */
+	struct vkhel_vector *ini = calloc(1, sizeof(struct vkhel_vector));
+	ini->ctx = parent->ctx;
+	ini->length = length;
+	ini->parent = parent->parent != NULL ? parent->parent : parent;
+	ini->device = parent->device;
+	ini->offset = parent->offset + offset * sizeof(uint64_t);
+	assert(ini->offset % ini->ctx->vk.min_storage_buffer_offset_alignment
+			== 0);
+	return ini;
+}
+
+VkDescriptorBufferInfo vkhel_vector_buffer_info(
+		const struct vkhel_vector *vector) {
+	return (VkDescriptorBufferInfo) {
+		.buffer = vector->device.buffer,
+		.offset = vector->offset,
+		.range = vector->length * sizeof(uint64_t),
+	};
+}
+
 void vkhel_vector_destroy(struct vkhel_vector *vector) {
 	struct vkhel_ctx *ctx = vector->ctx;
-	deallocate_backing_memory(&ctx->vk, &vector->device);
+	if (vector->parent != NULL) {
+		/* views at ever new offsets would otherwise pile up sets for a
+		 * buffer that lives on; the parent's own range stays cached */
+		const VkDescriptorBufferInfo range = vkhel_vector_buffer_info(vector);
+		if (range.offset != vector->parent->offset
+				|| range.range != vector->parent->length * sizeof(uint64_t)) {
+			descriptor_cache_invalidate_range(&ctx->vk, &range);
+		}
+		free(vector);
+		return;
+	}
+
+	vector_pool_release(&ctx->vk, &ctx->pool, &vector->device);
 	free(vector);
 }
 
 void vkhel_vector_dbgprint(const struct vkhel_vector *vector) {
-	uint64_t *mapped = NULL;
-	vkhel_vector_map((struct vkhel_vector *) vector, (void **) &mapped,
-			vector->length * sizeof(uint64_t));
+	const uint64_t *mapped = vkhel_vector_map_range(
+			(struct vkhel_vector *) vector, 0,
+			vector->length * sizeof(uint64_t), VKHEL_MAP_READ);
 	for (size_t i = 0; i < vector->length; i++) {
 		printf((i == vector->length - 1) ? ("%" PRIu64) : ("%" PRIu64 ", "),
 				mapped[i]);
@@ -254,54 +238,162 @@ struct vkhel_vector *vkhel_vector_dup(struct vkhel_vector *src) {
 	struct vkhel_vector *new = vkhel_vector_create2(src->ctx,
 			src->length, false);
 	res = copy_buffers(&ctx->vk, src->length * sizeof(uint64_t),
-			src->device.buffer, new->device.buffer);
+			src->device.buffer, src->offset, new->device.buffer, 0);
 	assert(res == VK_SUCCESS);
 	return new;
 }
 
+/* moves whole vectors between the host arrays and their device buffers;
+ * host visible vectors are copied in place, the rest share staging
+ * submissions */
+static void transfer_many(const struct vkhel_vector *const *vectors,
+		void *const *host, size_t count, bool upload) {
+	if (count == 0) {
+		return;
+	}
+	struct vulkan_ctx *vk = &vectors[0]->ctx->vk;
+
+	struct staging_copy *copies = malloc(count * sizeof(struct staging_copy));
+	assert(copies != NULL);
+	size_t copy_count = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		const struct vkhel_vector *vector = vectors[i];
+		assert(vector->ctx == vectors[0]->ctx);
+		const size_t size = vector->length * sizeof(uint64_t);
+
+		if (vector->device.mapped == NULL) {
+			copies[copy_count++] = (struct staging_copy) {
+				.buffer = vector->device.buffer,
+				.offset = vector->offset,
+				.host = host[i],
+				.size = size,
+			};
+			continue;
+		}
+
+		uint8_t *storage = (uint8_t *) vector->device.mapped + vector->offset;
+		VkResult res;
+		if (upload) {
+			memcpy(storage, host[i], size);
+			res = vmaFlushAllocation(vk->mem_allocator,
+					vector->device.allocation, vector->offset, size);
+		} else {
+			res = vmaInvalidateAllocation(vk->mem_allocator,
+					vector->device.allocation, vector->offset, size);
+			memcpy(host[i], storage, size);
+		}
+		assert(res == VK_SUCCESS);
+	}
+
+	if (upload) {
+		staging_ring_upload_many(vk, copies, copy_count);
+	} else {
+		staging_ring_download_many(vk, copies, copy_count);
+	}
+	free(copies);
+}
+
 void vkhel_vector_copy_from_host(struct vkhel_vector *vector,
 		const uint64_t *e) {
-	uint64_t *mapped;
-	vkhel_vector_map(vector, (void **) &mapped, vector->length * sizeof(uint64_t));
-	memcpy(mapped, e, vector->length * sizeof(uint64_t));
-	vkhel_vector_unmap(vector);
+	vkhel_vectors_copy_from_host_many(&vector, &e, 1);
 }
 
-void vkhel_vector_map(struct vkhel_vector *vector, void **mem, size_t size) {
-	VkResult res = VK_ERROR_UNKNOWN;
-	res = allocate_backing_memory(&vector->ctx->vk,
-			BACKING_MEMORY_USAGE_TRANSFER, size, &vector->host);
-	assert(res == VK_SUCCESS);
+void vkhel_vector_copy_to_host(const struct vkhel_vector *vector,
+		uint64_t *e) {
+	vkhel_vectors_copy_to_host_many(&vector, &e, 1);
+}
 
-	res = copy_buffers(&vector->ctx->vk, size,
-			vector->device.buffer, vector->host.buffer);
-	assert(res == VK_SUCCESS);
+void vkhel_vectors_copy_from_host_many(struct vkhel_vector *const *vectors,
+		const uint64_t *const *src, size_t count) {
+	transfer_many((const struct vkhel_vector *const *) vectors,
+			(void *const *) src, count, true);
+}
 
-	res = vmaMapMemory(vector->ctx->vk.mem_allocator,
-			vector->host.allocation, mem);
-	assert(res == VK_SUCCESS);
+void vkhel_vectors_copy_to_host_many(
+		const struct vkhel_vector *const *vectors,
+		uint64_t *const *dst, size_t count) {
+	transfer_many(vectors, (void *const *) dst, count, false);
 }
 
-void vkhel_vector_unmap(struct vkhel_vector *vector) {
-	VkResult res = VK_ERROR_UNKNOWN;
+void vkhel_vector_map(struct vkhel_vector *vector, void **mem, size_t size) {
+	*mem = vkhel_vector_map_range(vector, 0, size, VKHEL_MAP_READ_WRITE);
+}
 
-	vmaUnmapMemory(vector->ctx->vk.mem_allocator,
-			vector->host.allocation);
+void *vkhel_vector_map_range(struct vkhel_vector *vector, size_t offset,
+		size_t size, enum vkhel_map_mode mode) {
+	struct vulkan_ctx *vk = &vector->ctx->vk;
+	assert(vector->mapped == NULL);
+	assert(offset <= vector->length * sizeof(uint64_t)
+			&& size <= vector->length * sizeof(uint64_t) - offset);
+
+	/* offsets into the buffer from here on */
+	offset += vector->offset;
+	vector->mapped_offset = offset;
+	vector->mapped_size = size;
+	vector->map_mode = mode;
+
+	/* host visible storage is handed out directly, no copies needed */
+	if (vector->device.mapped != NULL) {
+		vector->mapped = (uint8_t *) vector->device.mapped + offset;
+		if (mode != VKHEL_MAP_WRITE_DISCARD) {
+			VkResult res = vmaInvalidateAllocation(vk->mem_allocator,
+					vector->device.allocation, offset, size);
+			assert(res == VK_SUCCESS);
+		}
+		return vector->mapped;
+	}
 
-	res = copy_buffers(&vector->ctx->vk, vector->length * sizeof(uint64_t),
-			vector->host.buffer, vector->device.buffer);
-	assert(res == VK_SUCCESS);
+	/* otherwise the range is kept in host memory while mapped, the
+	 * staging ring moves it in and out of the device buffer */
+	vector->mapped = malloc(size);
+	assert(size == 0 || vector->mapped != NULL);
+	if (mode != VKHEL_MAP_WRITE_DISCARD) {
+		staging_ring_download(vk, vector->device.buffer, offset,
+				vector->mapped, size);
+	}
+	return vector->mapped;
+}
 
-	deallocate_backing_memory(&vector->ctx->vk, &vector->host);
+void vkhel_vector_unmap(struct vkhel_vector *vector) {
+	struct vulkan_ctx *vk = &vector->ctx->vk;
+	const bool write_back = vector->map_mode != VKHEL_MAP_READ;
+
+	if (vector->device.mapped != NULL) {
+		if (write_back) {
+			VkResult res = vmaFlushAllocation(vk->mem_allocator,
+					vector->device.allocation, vector->mapped_offset,
+					vector->mapped_size);
+			assert(res == VK_SUCCESS);
+		}
+	} else {
+		if (write_back) {
+			staging_ring_upload(vk, vector->device.buffer,
+					vector->mapped_offset, vector->mapped, vector->mapped_size);
+		}
+		free(vector->mapped);
+	}
+	vector->mapped = NULL;
+	vector->mapped_offset = 0;
+	vector->mapped_size = 0;
 }
 
-void vkhel_vector_elemfma(
+struct vkhel_event *vkhel_vector_elemfma_async(
 		const struct vkhel_vector *a,
 		const struct vkhel_vector *b,
 		struct vkhel_vector *result, uint64_t multiplier, uint64_t mod) {
 	assert(a->ctx == b->ctx && b->ctx == result->ctx);
 	struct vkhel_ctx *ctx = a->ctx;
 
+	struct vkhel_batch *batch = vkhel_batch_begin(ctx);
+	vkhel_batch_elemfma(batch, a, b, result, multiplier, mod);
+	return vkhel_batch_submit_async(batch);
+}
+
+void vkhel_vector_elemfma(
+		const struct vkhel_vector *a,
+		const struct vkhel_vector *b,
+		struct vkhel_vector *result, uint64_t multiplier, uint64_t mod) {
 #ifdef VKHEL_DEBUG
 	printf("elemfma ("
 				"multiplier: %" PRIu64
@@ -313,25 +405,7 @@ void vkhel_vector_elemfma(
 	vkhel_vector_dbgprint(b);
 #endif
 
-	VkFence execution_fence;
-	vulkan_ctx_create_fence(&ctx->vk, &execution_fence, false);
-
-	struct vulkan_execution execution;
-	vulkan_ctx_execution_begin(&ctx->vk, &execution, 1);
-	vulkan_kernel_elemfma_record(&ctx->vk,
-			&ctx->vk.kernels[VULKAN_KERNEL_TYPE_ELEMFMA], &execution,
-			result, a, b, multiplier, mod);
-	vulkan_ctx_execution_end(&ctx->vk, &execution, execution_fence);
-
-	vkWaitForFences(ctx->vk.device, 1, &execution_fence, true, -1);
-	vkDestroyFence(ctx->vk.device, execution_fence, NULL);
-
-	vkDestroyDescriptorPool(ctx->vk.device, execution.descriptor_pool, NULL);
-
-	vkFreeCommandBuffers(ctx->vk.device, ctx->vk.cmd_pool, 1,
-			&execution.cmd_buffer);
-	vkResetCommandPool(ctx->vk.device, ctx->vk.cmd_pool,
-			VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
+	vkhel_event_wait(vkhel_vector_elemfma_async(a, b, result, multiplier, mod));
 
 #ifdef VKHEL_DEBUG
 	printf("\tresult: ");
@@ -339,45 +413,27 @@ void vkhel_vector_elemfma(
 #endif
 }
 
-void vkhel_vector_elemmod(
+struct vkhel_event *vkhel_vector_elemmod_async(
 		const struct vkhel_vector *operand,
 		struct vkhel_vector *result, uint64_t mod, uint64_t q) {
 	assert(operand->ctx == result->ctx);
 	struct vkhel_ctx *ctx = operand->ctx;
 
+	struct vkhel_batch *batch = vkhel_batch_begin(ctx);
+	vkhel_batch_elemmod(batch, operand, result, mod, q);
+	return vkhel_batch_submit_async(batch);
+}
+
+void vkhel_vector_elemmod(
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result, uint64_t mod, uint64_t q) {
 #ifdef VKHEL_DEBUG
 	printf("elemmod mod: %" PRIu64 ", q: %" PRIu64 "\n", mod, q);
 	printf("\toperand: ");
 	vkhel_vector_dbgprint(operand);
 #endif
 
-	VkFence execution_fence;
-	vulkan_ctx_create_fence(&ctx->vk, &execution_fence, false);
-
-	struct vulkan_execution execution;
-	vulkan_ctx_execution_begin(&ctx->vk, &execution, 1);
-
-	if (mod == 2) {
-		vulkan_kernel_elemmodbytwo_record(&ctx->vk,
-				&ctx->vk.kernels[VULKAN_KERNEL_TYPE_ELEMMODBYTWO], &execution,
-				result, operand, q / 2);
-	} else {
-		vulkan_kernel_elemgtsub_record(&ctx->vk,
-				&ctx->vk.kernels[VULKAN_KERNEL_TYPE_ELEMGTSUB], &execution,
-				result, operand, q / 2, q, mod);
-	}
-
-	vulkan_ctx_execution_end(&ctx->vk, &execution, execution_fence);
-
-	vkWaitForFences(ctx->vk.device, 1, &execution_fence, true, -1);
-	vkDestroyFence(ctx->vk.device, execution_fence, NULL);
-
-	vkDestroyDescriptorPool(ctx->vk.device, execution.descriptor_pool, NULL);
-
-	vkFreeCommandBuffers(ctx->vk.device, ctx->vk.cmd_pool, 1,
-			&execution.cmd_buffer);
-	vkResetCommandPool(ctx->vk.device, ctx->vk.cmd_pool,
-			VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
+	vkhel_event_wait(vkhel_vector_elemmod_async(operand, result, mod, q));
 
 #ifdef VKHEL_DEBUG
 	printf("\tresult: ");
@@ -385,13 +441,22 @@ void vkhel_vector_elemmod(
 #endif
 }
 
-void vkhel_vector_elemmul(
+struct vkhel_event *vkhel_vector_elemmul_async(
 		const struct vkhel_vector *a,
 		const struct vkhel_vector *b,
 		struct vkhel_vector *result, uint64_t mod) {
 	assert(a->ctx == b->ctx && b->ctx == result->ctx);
 	struct vkhel_ctx *ctx = a->ctx;
 
+	struct vkhel_batch *batch = vkhel_batch_begin(ctx);
+	vkhel_batch_elemmul(batch, a, b, result, mod);
+	return vkhel_batch_submit_async(batch);
+}
+
+void vkhel_vector_elemmul(
+		const struct vkhel_vector *a,
+		const struct vkhel_vector *b,
+		struct vkhel_vector *result, uint64_t mod) {
 #ifdef VKHEL_DEBUG
 	printf("elemmul mod: %" PRIu64 "\n", mod);
 	printf("\ta: ");
@@ -400,25 +465,7 @@ void vkhel_vector_elemmul(
 	vkhel_vector_dbgprint(b);
 #endif
 
-	VkFence execution_fence;
-	vulkan_ctx_create_fence(&ctx->vk, &execution_fence, false);
-
-	struct vulkan_execution execution;
-	vulkan_ctx_execution_begin(&ctx->vk, &execution, 1);
-	vulkan_kernel_elemmul_record(&ctx->vk,
-			&ctx->vk.kernels[VULKAN_KERNEL_TYPE_ELEMMUL], &execution,
-			result, a, b, mod);
-	vulkan_ctx_execution_end(&ctx->vk, &execution, execution_fence);
-
-	vkWaitForFences(ctx->vk.device, 1, &execution_fence, true, -1);
-	vkDestroyFence(ctx->vk.device, execution_fence, NULL);
-
-	vkDestroyDescriptorPool(ctx->vk.device, execution.descriptor_pool, NULL);
-
-	vkFreeCommandBuffers(ctx->vk.device, ctx->vk.cmd_pool, 1,
-			&execution.cmd_buffer);
-	vkResetCommandPool(ctx->vk.device, ctx->vk.cmd_pool,
-			VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
+	vkhel_event_wait(vkhel_vector_elemmul_async(a, b, result, mod));
 
 #ifdef VKHEL_DEBUG
 	printf("\tresult: ");
@@ -426,12 +473,20 @@ void vkhel_vector_elemmul(
 #endif
 }
 
-void vkhel_vector_elemgtadd(
+struct vkhel_event *vkhel_vector_elemgtadd_async(
 		const struct vkhel_vector *operand,
 		struct vkhel_vector *result, uint64_t bound, uint64_t diff) {
 	assert(operand->ctx == result->ctx);
 	struct vkhel_ctx *ctx = result->ctx;
 
+	struct vkhel_batch *batch = vkhel_batch_begin(ctx);
+	vkhel_batch_elemgtadd(batch, operand, result, bound, diff);
+	return vkhel_batch_submit_async(batch);
+}
+
+void vkhel_vector_elemgtadd(
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result, uint64_t bound, uint64_t diff) {
 #ifdef VKHEL_DEBUG
 	printf("elemgtadd ("
 				"bound: %" PRIu64
@@ -441,25 +496,8 @@ void vkhel_vector_elemgtadd(
 	vkhel_vector_dbgprint(operand);
 #endif
 
-	VkFence execution_fence;
-	vulkan_ctx_create_fence(&ctx->vk, &execution_fence, false);
-
-	struct vulkan_execution execution;
-	vulkan_ctx_execution_begin(&ctx->vk, &execution, 1);
-	vulkan_kernel_elemgtadd_record(&ctx->vk,
-			&ctx->vk.kernels[VULKAN_KERNEL_TYPE_ELEMGTADD], &execution,
-			result, operand, bound, diff);
-	vulkan_ctx_execution_end(&ctx->vk, &execution, execution_fence);
-
-	vkWaitForFences(ctx->vk.device, 1, &execution_fence, true, -1);
-	vkDestroyFence(ctx->vk.device, execution_fence, NULL);
-
-	vkDestroyDescriptorPool(ctx->vk.device, execution.descriptor_pool, NULL);
-
-	vkFreeCommandBuffers(ctx->vk.device, ctx->vk.cmd_pool, 1,
-			&execution.cmd_buffer);
-	vkResetCommandPool(ctx->vk.device, ctx->vk.cmd_pool,
-			VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
+	vkhel_event_wait(vkhel_vector_elemgtadd_async(operand, result,
+				bound, diff));
 
 #ifdef VKHEL_DEBUG
 	printf("\tresult: ");
@@ -467,13 +505,22 @@ void vkhel_vector_elemgtadd(
 #endif
 }
 
-void vkhel_vector_elemgtsub(
+struct vkhel_event *vkhel_vector_elemgtsub_async(
 		const struct vkhel_vector *operand,
 		struct vkhel_vector *result,
 		uint64_t bound, uint64_t diff, uint64_t mod) {
 	assert(operand->ctx == result->ctx);
 	struct vkhel_ctx *ctx = result->ctx;
 
+	struct vkhel_batch *batch = vkhel_batch_begin(ctx);
+	vkhel_batch_elemgtsub(batch, operand, result, bound, diff, mod);
+	return vkhel_batch_submit_async(batch);
+}
+
+void vkhel_vector_elemgtsub(
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		uint64_t bound, uint64_t diff, uint64_t mod) {
 #ifdef VKHEL_DEBUG
 	printf("elemgtsub ("
 				"bound: %" PRIu64
@@ -484,25 +531,8 @@ void vkhel_vector_elemgtsub(
 	vkhel_vector_dbgprint(operand);
 #endif
 
-	VkFence execution_fence;
-	vulkan_ctx_create_fence(&ctx->vk, &execution_fence, false);
-
-	struct vulkan_execution execution;
-	vulkan_ctx_execution_begin(&ctx->vk, &execution, 1);
-	vulkan_kernel_elemgtsub_record(&ctx->vk,
-			&ctx->vk.kernels[VULKAN_KERNEL_TYPE_ELEMGTSUB], &execution,
-			result, operand, bound, diff, mod);
-	vulkan_ctx_execution_end(&ctx->vk, &execution, execution_fence);
-
-	vkWaitForFences(ctx->vk.device, 1, &execution_fence, true, -1);
-	vkDestroyFence(ctx->vk.device, execution_fence, NULL);
-
-	vkDestroyDescriptorPool(ctx->vk.device, execution.descriptor_pool, NULL);
-
-	vkFreeCommandBuffers(ctx->vk.device, ctx->vk.cmd_pool, 1,
-			&execution.cmd_buffer);
-	vkResetCommandPool(ctx->vk.device, ctx->vk.cmd_pool,
-			VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
+	vkhel_event_wait(vkhel_vector_elemgtsub_async(operand, result, bound,
+				diff, mod));
 
 #ifdef VKHEL_DEBUG
 	printf("\tresult: ");
@@ -510,13 +540,84 @@ void vkhel_vector_elemgtsub(
 #endif
 }
 
-void vkhel_vector_forward_transform(
+void vkhel_vector_record_forward_transform(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		struct vkhel_ntt_tables *ntt) {
+	const struct vkhel_vector *input = operand;
+
+	/* stages whose butterfly groups do not fit in shared memory */
+	uint64_t t = ntt->n / 2;
+	uint64_t m = 1;
+	for (; t > NTTFWDFUSED_MAX_TRANSFORM_SIZE; t /= 2, m *= 2) {
+		if (m > 1) {
+			vulkan_ctx_execution_barrier(vk, execution);
+		}
+
+		vulkan_kernel_nttfwdbutterfly_record(vk,
+				vulkan_ctx_kernel(vk, VULKAN_KERNEL_TYPE_NTTFWDBUTTERFLY),
+				execution, ntt, m, t, input, result);
+
+		input = result;
+	}
+
+	/* the remaining log2(t) + 1 stages run in a single dispatch */
+	if (m > 1) {
+		vulkan_ctx_execution_barrier(vk, execution);
+	}
+	vulkan_kernel_nttfwdfused_record(vk,
+			vulkan_ctx_kernel(vk, VULKAN_KERNEL_TYPE_NTTFWDFUSED),
+			execution, ntt, t, input, result);
+}
+
+void vkhel_vector_record_inverse_transform(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution,
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		struct vkhel_ntt_tables *ntt) {
+	/* the first stages run in a single dispatch, as long as their butterfly
+	 * groups fit in shared memory */
+	uint64_t t = ntt->n / 2 > NTTREVFUSED_MAX_TRANSFORM_SIZE
+		? NTTREVFUSED_MAX_TRANSFORM_SIZE : ntt->n / 2;
+	vulkan_kernel_nttrevfused_record(vk,
+			vulkan_ctx_kernel(vk, VULKAN_KERNEL_TYPE_NTTREVFUSED),
+			execution, ntt, t, operand, result);
+
+	for (uint64_t m = ntt->n / (4 * t); m >= 1; m /= 2) {
+		t *= 2;
+
+		vulkan_ctx_execution_barrier(vk, execution);
+		vulkan_kernel_nttrevbutterfly_record(vk,
+				vulkan_ctx_kernel(vk, VULKAN_KERNEL_TYPE_NTTREVBUTTERFLY),
+				execution, ntt, m, t, result, result);
+	}
+
+	/* need to adjust all elements by inv(N) */
+	const uint64_t inv_n = nt_inverse_mod(ntt->n, ntt->q);
+
+	vulkan_ctx_execution_barrier(vk, execution);
+	vulkan_kernel_elemmulconst_record(vk,
+			vulkan_ctx_kernel(vk, VULKAN_KERNEL_TYPE_ELEMMULCONST),
+			execution, result, result, inv_n, ntt->q);
+}
+
+struct vkhel_event *vkhel_vector_forward_transform_async(
 		const struct vkhel_vector *operand,
 		struct vkhel_vector *result,
 		struct vkhel_ntt_tables *ntt) {
 	assert(operand->ctx == result->ctx);
 	struct vkhel_ctx *ctx = operand->ctx;
 
+	struct vkhel_batch *batch = vkhel_batch_begin(ctx);
+	vkhel_batch_forward_transform(batch, operand, result, ntt);
+	return vkhel_batch_submit_async(batch);
+}
+
+void vkhel_vector_forward_transform(
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		struct vkhel_ntt_tables *ntt) {
 #ifdef VKHEL_DEBUG
 	printf("forward transform ("
 				"degree: %" PRIu64
@@ -527,45 +628,8 @@ void vkhel_vector_forward_transform(
 	vkhel_vector_dbgprint(operand);
 #endif
 
-	VkFence execution_fence;
-	vulkan_ctx_create_fence(&ctx->vk, &execution_fence, false);
-
-	const struct vkhel_vector *input = operand;
-
-	struct vulkan_execution execution;
-	uint64_t t = ntt->n / 2;
-	for (uint64_t m = 1; m < ntt->n; m *= 2) {
-		uint64_t offset = 0;
-
-		vulkan_ctx_execution_begin(&ctx->vk, &execution, m);
-		for (size_t i = 0; i < m; i++) {
-			vulkan_kernel_nttfwdbutterfly_record(&ctx->vk,
-					&ctx->vk.kernels[VULKAN_KERNEL_TYPE_NTTFWDBUTTERFLY],
-					&execution, ntt, ntt->q, m + i, t, offset, input, result);
-
-			offset += t * 2;
-		}
-		vulkan_ctx_execution_end(&ctx->vk, &execution, execution_fence);
-		vkWaitForFences(ctx->vk.device, 1, &execution_fence, true, -1);
-		vkResetFences(ctx->vk.device, 1, &execution_fence);
-
-		vkFreeCommandBuffers(ctx->vk.device, ctx->vk.cmd_pool, 1,
-				&execution.cmd_buffer);
-		vkResetCommandPool(ctx->vk.device, ctx->vk.cmd_pool,
-				VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
-
-		vkDestroyDescriptorPool(ctx->vk.device, execution.descriptor_pool, NULL);
-
-#ifdef VKHEL_DEBUG
-		printf("\t\tm=%" PRIu64 " result: ", m);
-		vkhel_vector_dbgprint(result);
-#endif
-
-		t /= 2;
-		input = result;
-	}
-
-	vkDestroyFence(ctx->vk.device, execution_fence, NULL);
+	vkhel_event_wait(vkhel_vector_forward_transform_async(operand,
+				result, ntt));
 
 #ifdef VKHEL_DEBUG
 	printf("\tresult: ");
@@ -573,13 +637,22 @@ void vkhel_vector_forward_transform(
 #endif
 }
 
-void vkhel_vector_inverse_transform(
+struct vkhel_event *vkhel_vector_inverse_transform_async(
 		const struct vkhel_vector *operand,
 		struct vkhel_vector *result,
 		struct vkhel_ntt_tables *ntt) {
 	assert(operand->ctx == result->ctx);
 	struct vkhel_ctx *ctx = operand->ctx;
 
+	struct vkhel_batch *batch = vkhel_batch_begin(ctx);
+	vkhel_batch_inverse_transform(batch, operand, result, ntt);
+	return vkhel_batch_submit_async(batch);
+}
+
+void vkhel_vector_inverse_transform(
+		const struct vkhel_vector *operand,
+		struct vkhel_vector *result,
+		struct vkhel_ntt_tables *ntt) {
 #ifdef VKHEL_DEBUG
 	printf("inverse transform ("
 				"degree: %" PRIu64
@@ -590,65 +663,8 @@ void vkhel_vector_inverse_transform(
 	vkhel_vector_dbgprint(operand);
 #endif
 
-	VkFence execution_fence;
-	vulkan_ctx_create_fence(&ctx->vk, &execution_fence, false);
-
-	const struct vkhel_vector *input = operand;
-
-	struct vulkan_execution execution;
-	uint64_t t = 1;
-	for (uint64_t m = ntt->n / 2; m >= 1; m /= 2) {
-		uint64_t offset = 0;
-
-		vulkan_ctx_execution_begin(&ctx->vk, &execution, m);
-		for (size_t i = 0; i < m; i++) {
-			vulkan_kernel_nttrevbutterfly_record(&ctx->vk,
-					&ctx->vk.kernels[VULKAN_KERNEL_TYPE_NTTREVBUTTERFLY],
-					&execution, ntt, ntt->q, m + i, t, offset, input, result);
-			offset += t * 2;
-		}
-
-		vulkan_ctx_execution_end(&ctx->vk, &execution, execution_fence);
-
-		vkWaitForFences(ctx->vk.device, 1, &execution_fence, true, -1);
-		vkResetFences(ctx->vk.device, 1, &execution_fence);
-
-		vkDestroyDescriptorPool(ctx->vk.device, execution.descriptor_pool, NULL);
-
-		vkFreeCommandBuffers(ctx->vk.device, ctx->vk.cmd_pool, 1,
-				&execution.cmd_buffer);
-		vkResetCommandPool(ctx->vk.device, ctx->vk.cmd_pool,
-				VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
-
-#ifdef VKHEL_DEBUG
-		printf("\t\tm=%" PRIu64 " result: ", m);
-		vkhel_vector_dbgprint(result);
-#endif
-
-		t *= 2;
-		input = result;
-	}
-
-	/* need to adjust all elements by inv(N) */
-	const uint64_t inv_n = nt_inverse_mod(ntt->n, ntt->q);
-
-	vulkan_ctx_execution_begin(&ctx->vk, &execution, 1);
-	vulkan_kernel_elemmulconst_record(&ctx->vk, 
-			&ctx->vk.kernels[VULKAN_KERNEL_TYPE_ELEMMULCONST],
-			&execution, result, result, inv_n, ntt->q);
-	vulkan_ctx_execution_end(&ctx->vk, &execution, execution_fence);
-
-	vkWaitForFences(ctx->vk.device, 1, &execution_fence, true, -1);
-	vkResetFences(ctx->vk.device, 1, &execution_fence);
-
-	vkDestroyDescriptorPool(ctx->vk.device, execution.descriptor_pool, NULL);
-
-	vkFreeCommandBuffers(ctx->vk.device, ctx->vk.cmd_pool, 1,
-			&execution.cmd_buffer);
-	vkResetCommandPool(ctx->vk.device, ctx->vk.cmd_pool,
-			VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
-
-	vkDestroyFence(ctx->vk.device, execution_fence, NULL);
+	vkhel_event_wait(vkhel_vector_inverse_transform_async(operand,
+				result, ntt));
 
 #ifdef VKHEL_DEBUG
 	printf("\tresult: ");
@@ -0,0 +1,121 @@
+#include <assert.h>
+#include <stdlib.h>
+#include "priv/vector_pool.h"
+#include "priv/vulkan.h"
+
+static size_t size_class(uint64_t size) {
+	if (size <= (1ull << VECTOR_POOL_MIN_CLASS)) {
+		return VECTOR_POOL_MIN_CLASS;
+	}
+	return 64 - __builtin_clzll(size - 1);
+}
+
+/* buffers whose class is larger than the whole pool could never be
+ * retained, so they keep their exact size */
+static bool poolable(const struct vector_pool *pool, uint64_t size) {
+	return pool->max_bytes != 0
+		&& (1ull << size_class(size)) <= pool->max_bytes;
+}
+
+static void destroy_memory(struct vulkan_ctx *vk,
+		const struct backing_memory *memory) {
+	descriptor_cache_invalidate(vk, memory->buffer);
+	vmaDestroyBuffer(vk->mem_allocator, memory->buffer, memory->allocation);
+}
+
+void vector_pool_init(struct vector_pool *pool, uint64_t max_bytes,
+		uint32_t max_per_class) {
+	pthread_mutex_init(&pool->lock, NULL);
+	for (size_t i = 0; i < VECTOR_POOL_CLASS_COUNT; i++) {
+		pool->classes[i] = NULL;
+		pool->class_counts[i] = 0;
+	}
+	pool->retained_bytes = 0;
+	pool->max_bytes = max_bytes;
+	pool->max_per_class = max_per_class;
+}
+
+uint64_t vector_pool_buffer_size(const struct vector_pool *pool,
+		uint64_t size) {
+	if (!poolable(pool, size)) {
+		return size;
+	}
+	return 1ull << size_class(size);
+}
+
+bool vector_pool_take(struct vector_pool *pool, uint64_t size,
+		struct backing_memory *memory) {
+	if (!poolable(pool, size)) {
+		return false;
+	}
+
+	const size_t class = size_class(size);
+	pthread_mutex_lock(&pool->lock);
+	struct vector_pool_entry *entry = pool->classes[class];
+	if (entry == NULL) {
+		pthread_mutex_unlock(&pool->lock);
+		return false;
+	}
+	pool->classes[class] = entry->next;
+	pool->class_counts[class]--;
+	pool->retained_bytes -= entry->memory.size;
+	pthread_mutex_unlock(&pool->lock);
+
+	*memory = entry->memory;
+	free(entry);
+	return true;
+}
+
+void vector_pool_release(struct vulkan_ctx *vk, struct vector_pool *pool,
+		const struct backing_memory *memory) {
+	/* only buffers created with a class size are pooled */
+	const size_t class = size_class(memory->size);
+	if (pool->max_bytes == 0 || memory->size != (1ull << class)) {
+		destroy_memory(vk, memory);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	if (pool->class_counts[class] >= pool->max_per_class
+			|| pool->retained_bytes + memory->size > pool->max_bytes) {
+		pthread_mutex_unlock(&pool->lock);
+		destroy_memory(vk, memory);
+		return;
+	}
+
+	/* the next vector may have another length, and every length would
+	 * add sets for the buffer while it never leaves the pool */
+	descriptor_cache_invalidate(vk, memory->buffer);
+
+	struct vector_pool_entry *entry = malloc(sizeof(struct vector_pool_entry));
+	assert(entry != NULL);
+	entry->memory = *memory;
+	entry->next = pool->classes[class];
+	pool->classes[class] = entry;
+	pool->class_counts[class]++;
+	pool->retained_bytes += memory->size;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void vector_pool_trim(struct vulkan_ctx *vk, struct vector_pool *pool,
+		uint64_t keep_bytes) {
+	pthread_mutex_lock(&pool->lock);
+	for (size_t class = VECTOR_POOL_CLASS_COUNT; class-- > 0;) {
+		while (pool->retained_bytes > keep_bytes
+				&& pool->classes[class] != NULL) {
+			struct vector_pool_entry *entry = pool->classes[class];
+			pool->classes[class] = entry->next;
+			pool->class_counts[class]--;
+			pool->retained_bytes -= entry->memory.size;
+
+			destroy_memory(vk, &entry->memory);
+			free(entry);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void vector_pool_finish(struct vulkan_ctx *vk, struct vector_pool *pool) {
+	vector_pool_trim(vk, pool, 0);
+	pthread_mutex_destroy(&pool->lock);
+}
@@ -1,13 +1,95 @@
+#include <assert.h>
 #include <stdlib.h>
 #include "priv/vkhel.h"
 
+void vkhel_ctx_options_init(struct vkhel_ctx_options *options) {
+	*options = (struct vkhel_ctx_options) {
+		.device_index = -1,
+		.device_name = NULL,
+		.device_type = VKHEL_DEVICE_TYPE_ANY,
+		.queue_count = 1,
+		.pipeline_cache = true,
+		.push_descriptors = true,
+		.pipeline_cache_path = NULL,
+		.memory_budget = 0,
+		.host_visible_vectors = true,
+		.tuning_path = NULL,
+		.pool_bytes = 0,
+		.pool_buffers_per_class = 16,
+	};
+}
+
 struct vkhel_ctx *vkhel_ctx_create() {
+	struct vkhel_ctx_options options;
+	vkhel_ctx_options_init(&options);
+
+	struct vkhel_ctx *ctx = vkhel_ctx_create_with_options(&options);
+	assert(ctx != NULL);
+	return ctx;
+}
+
+struct vkhel_ctx *vkhel_ctx_create_with_options(
+		const struct vkhel_ctx_options *options) {
 	struct vkhel_ctx *ctx = calloc(1, sizeof(struct vkhel_ctx));
-	vulkan_ctx_init(&ctx->vk);
+	if (vulkan_ctx_init(&ctx->vk, options) == NULL) {
+		free(ctx);
+		return NULL;
+	}
+	vector_pool_init(&ctx->pool, options->pool_bytes,
+			options->pool_buffers_per_class);
 	return ctx;
 }
 
+struct vkhel_ctx *vkhel_ctx_create_on_device(uint32_t index) {
+	struct vkhel_ctx_options options;
+	vkhel_ctx_options_init(&options);
+	options.device_index = index;
+	return vkhel_ctx_create_with_options(&options);
+}
+
+/* the public bits follow the order of enum vulkan_kernel_type */
+static uint32_t kernel_mask(uint32_t kernels) {
+	static const uint32_t types[] = {
+		[VULKAN_KERNEL_TYPE_ELEMFMA] = VKHEL_KERNEL_ELEMFMA,
+		[VULKAN_KERNEL_TYPE_ELEMMUL] = VKHEL_KERNEL_ELEMMUL,
+		[VULKAN_KERNEL_TYPE_ELEMGTADD] = VKHEL_KERNEL_ELEMGTADD,
+		[VULKAN_KERNEL_TYPE_ELEMGTSUB] = VKHEL_KERNEL_ELEMGTSUB,
+		[VULKAN_KERNEL_TYPE_NTTFWDBUTTERFLY] = VKHEL_KERNEL_NTTFWDBUTTERFLY,
+		[VULKAN_KERNEL_TYPE_NTTREVBUTTERFLY] = VKHEL_KERNEL_NTTREVBUTTERFLY,
+		[VULKAN_KERNEL_TYPE_ELEMMULCONST] = VKHEL_KERNEL_ELEMMULCONST,
+		[VULKAN_KERNEL_TYPE_ELEMMODBYTWO] = VKHEL_KERNEL_ELEMMODBYTWO,
+		[VULKAN_KERNEL_TYPE_NTTFWDFUSED] = VKHEL_KERNEL_NTTFWDFUSED,
+		[VULKAN_KERNEL_TYPE_NTTREVFUSED] = VKHEL_KERNEL_NTTREVFUSED,
+	};
+
+	uint32_t mask = 0;
+	for (size_t i = 0; i < VULKAN_KERNEL_TYPE_MAX; i++) {
+		if (kernels & types[i]) {
+			mask |= 1u << i;
+		}
+	}
+	return mask;
+}
+
+void vkhel_ctx_prewarm(struct vkhel_ctx *ctx, uint32_t kernels) {
+	vulkan_ctx_prewarm(&ctx->vk, kernel_mask(kernels), false);
+}
+
+void vkhel_ctx_prewarm_async(struct vkhel_ctx *ctx, uint32_t kernels) {
+	vulkan_ctx_prewarm(&ctx->vk, kernel_mask(kernels), true);
+}
+
+void vkhel_ctx_specialize(struct vkhel_ctx *ctx, uint64_t mod,
+		uint32_t local_size) {
+	vulkan_ctx_specialize(&ctx->vk, mod, local_size);
+}
+
+void vkhel_ctx_trim(struct vkhel_ctx *ctx, uint64_t keep_bytes) {
+	vector_pool_trim(&ctx->vk, &ctx->pool, keep_bytes);
+}
+
 void vkhel_ctx_destroy(struct vkhel_ctx *ctx) {
+	vector_pool_finish(&ctx->vk, &ctx->pool);
 	vulkan_ctx_finish(&ctx->vk);
 	free(ctx);
 }
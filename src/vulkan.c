@@ -1,6 +1,9 @@
 #include <assert.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "priv/kernels/elemfma.h"
 #include "priv/kernels/elemmodbytwo.h"
 #include "priv/kernels/elemmul.h"
@@ -8,8 +11,13 @@
 #include "priv/kernels/elemgtadd.h"
 #include "priv/kernels/elemgtsub.h"
 #include "priv/kernels/nttfwdbutterfly.h"
+#include "priv/kernels/nttfwdfused.h"
 #include "priv/kernels/nttrevbutterfly.h"
+#include "priv/kernels/nttrevfused.h"
+#include "priv/numbers.h"
+#include "priv/tuning.h"
 #include "priv/vulkan.h"
+#include <vkhel.h>
 
 typedef void (*vulkan_kernel_init_fn)(struct vulkan_ctx *);
 static const vulkan_kernel_init_fn vulkan_kernel_inits[VULKAN_KERNEL_TYPE_MAX] = {
@@ -21,13 +29,33 @@ static const vulkan_kernel_init_fn vulkan_kernel_inits[VULKAN_KERNEL_TYPE_MAX] =
 	[VULKAN_KERNEL_TYPE_NTTREVBUTTERFLY] = vulkan_kernel_nttrevbutterfly_init,
 	[VULKAN_KERNEL_TYPE_ELEMMULCONST] = vulkan_kernel_elemmulconst_init,
 	[VULKAN_KERNEL_TYPE_ELEMMODBYTWO] = vulkan_kernel_elemmodbytwo_init,
+	[VULKAN_KERNEL_TYPE_NTTFWDFUSED] = vulkan_kernel_nttfwdfused_init,
+	[VULKAN_KERNEL_TYPE_NTTREVFUSED] = vulkan_kernel_nttrevfused_init,
 };
 
+static void free_retired_pipelines(struct vulkan_ctx *vk,
+		struct vulkan_kernel *kernel) {
+	while (kernel->retired != NULL) {
+		struct vulkan_retired_pipeline *retired = kernel->retired;
+		kernel->retired = retired->next;
+		vkDestroyPipeline(vk->device, retired->pipeline, NULL);
+		free(retired);
+	}
+}
+
 static void vulkan_kernel_finish(struct vulkan_ctx *vk,
 		struct vulkan_kernel *kernel) {
+	while (kernel->variants != NULL) {
+		struct vulkan_kernel_variant *variant = kernel->variants;
+		kernel->variants = variant->next;
+		vkDestroyPipeline(vk->device, variant->pipeline, NULL);
+		free(variant);
+	}
+	free_retired_pipelines(vk, kernel);
 	vkDestroyDescriptorSetLayout(vk->device, kernel->set_layout, NULL);
 	vkDestroyPipelineLayout(vk->device, kernel->pipeline_layout, NULL);
 	vkDestroyPipeline(vk->device, kernel->pipeline, NULL);
+	vkDestroyPipeline(vk->device, kernel->scalar_pipeline, NULL);
 	vkDestroyShaderModule(vk->device, kernel->shader, NULL);
 }
 
@@ -45,6 +73,164 @@ static uint32_t find_compute_queue(VkPhysicalDevice device) {
     return candidate;
 }
 
+/* prefers a dedicated transfer family, then a spare queue of the compute
+ * family; returns false if copies have to share the first compute queue */
+static bool find_transfer_queue(VkPhysicalDevice device,
+		uint32_t compute_family, uint32_t compute_queue_count,
+		uint32_t *family, uint32_t *index) {
+	uint32_t count = 8;
+	VkQueueFamilyProperties properties[8];
+	vkGetPhysicalDeviceQueueFamilyProperties(device, &count, properties);
+
+	for (uint32_t i = 0; i < count; i++) {
+		const VkQueueFlags flags = properties[i].queueFlags;
+		if ((flags & VK_QUEUE_TRANSFER_BIT)
+				&& !(flags & (VK_QUEUE_COMPUTE_BIT | VK_QUEUE_GRAPHICS_BIT))) {
+			*family = i;
+			*index = 0;
+			return true;
+		}
+	}
+
+	if (properties[compute_family].queueCount > compute_queue_count) {
+		*family = compute_family;
+		*index = compute_queue_count;
+		return true;
+	}
+	return false;
+}
+
+static uint32_t get_queue_count(VkPhysicalDevice device, uint32_t family) {
+	uint32_t count = 8;
+	VkQueueFamilyProperties properties[8];
+	vkGetPhysicalDeviceQueueFamilyProperties(device, &count, properties);
+	return properties[family].queueCount;
+}
+
+static void vulkan_queue_init(struct vulkan_ctx *vk,
+		struct vulkan_queue *queue, enum vulkan_queue_type type,
+		uint32_t family, uint32_t index) {
+	queue->type = type;
+	queue->family_index = family;
+	vkGetDeviceQueue(vk->device, family, index, &queue->queue);
+
+	pthread_mutex_init(&queue->lock, NULL);
+	queue->submit_lock = &queue->lock;
+	if (type == VULKAN_QUEUE_TYPE_TRANSFER
+			&& queue->queue == vk->compute_queues[0].queue) {
+		queue->submit_lock = &vk->compute_queues[0].lock;
+	}
+}
+
+static void vulkan_cmd_pool_init(struct vulkan_ctx *vk,
+		struct vulkan_cmd_pool *pool, uint32_t family) {
+	VkCommandPoolCreateInfo cmd_pool_create_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+		.queueFamilyIndex = family,
+	};
+	VkResult res = vkCreateCommandPool(vk->device, &cmd_pool_create_info,
+			NULL, &pool->cmd_pool);
+	assert(res == VK_SUCCESS);
+
+	pthread_mutex_init(&pool->lock, NULL);
+}
+
+static void vulkan_cmd_pool_finish(struct vulkan_ctx *vk,
+		struct vulkan_cmd_pool *pool) {
+	/* destroying the pool frees the command buffers */
+	free(pool->free_cmd_buffers);
+	vkDestroyCommandPool(vk->device, pool->cmd_pool, NULL);
+	pthread_mutex_destroy(&pool->lock);
+}
+
+static void vulkan_thread_exit(void *data) {
+	struct vulkan_thread *thread = data;
+	struct vulkan_ctx *vk = thread->vk;
+
+	pthread_mutex_lock(&vk->lock);
+	thread->next_idle = vk->idle_threads;
+	vk->idle_threads = thread;
+	pthread_mutex_unlock(&vk->lock);
+}
+
+static struct vulkan_thread *vulkan_ctx_thread(struct vulkan_ctx *vk) {
+	struct vulkan_thread *thread = pthread_getspecific(vk->thread_key);
+	if (thread != NULL) {
+		return thread;
+	}
+
+	pthread_mutex_lock(&vk->lock);
+	if (vk->idle_threads != NULL) {
+		thread = vk->idle_threads;
+		vk->idle_threads = thread->next_idle;
+	} else {
+		thread = calloc(1, sizeof(struct vulkan_thread));
+		thread->vk = vk;
+		thread->queues[VULKAN_QUEUE_TYPE_COMPUTE] = &vk->compute_queues[
+			vk->next_compute_queue++ % vk->compute_queue_count];
+		thread->queues[VULKAN_QUEUE_TYPE_TRANSFER] = &vk->transfer;
+		for (size_t i = 0; i < VULKAN_QUEUE_TYPE_MAX; i++) {
+			vulkan_cmd_pool_init(vk, &thread->cmd_pools[i],
+					thread->queues[i]->family_index);
+		}
+		thread->next = vk->threads;
+		vk->threads = thread;
+	}
+	pthread_mutex_unlock(&vk->lock);
+
+	pthread_setspecific(vk->thread_key, thread);
+	return thread;
+}
+
+static bool is_suitable_device(VkPhysicalDevice device) {
+	VkPhysicalDeviceFeatures features;
+	vkGetPhysicalDeviceFeatures(device, &features);
+	return features.shaderInt64
+		&& (int32_t) find_compute_queue(device) >= 0;
+}
+
+/* higher is preferred when no device is requested explicitly */
+static int device_type_rank(VkPhysicalDeviceType type) {
+	switch (type) {
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+			return 4;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+			return 3;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+			return 2;
+		case VK_PHYSICAL_DEVICE_TYPE_CPU:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+static bool device_matches(const VkPhysicalDeviceProperties *properties,
+		const struct vkhel_ctx_options *options) {
+	if (options->device_name != NULL
+			&& strstr(properties->deviceName, options->device_name) == NULL) {
+		return false;
+	}
+
+	switch (options->device_type) {
+		case VKHEL_DEVICE_TYPE_ANY:
+			return true;
+		case VKHEL_DEVICE_TYPE_DISCRETE_GPU:
+			return properties->deviceType
+				== VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU;
+		case VKHEL_DEVICE_TYPE_INTEGRATED_GPU:
+			return properties->deviceType
+				== VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU;
+		case VKHEL_DEVICE_TYPE_VIRTUAL_GPU:
+			return properties->deviceType
+				== VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU;
+		case VKHEL_DEVICE_TYPE_CPU:
+			return properties->deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+	}
+	assert(false);
+}
+
 static uint32_t find_memory_index(
 		VkPhysicalDeviceMemoryProperties *memory_properties,
 		VkMemoryPropertyFlags flags) {
@@ -56,6 +242,49 @@ static uint32_t find_memory_index(
 	return -1;
 }
 
+/* a device local type the host can read through its caches means the
+ * device shares system memory, as on integrated GPUs and CPU
+ * implementations; the device local, host visible window of discrete GPUs
+ * is uncached and is left alone */
+static bool has_unified_memory(
+		const VkPhysicalDeviceMemoryProperties *memory_properties) {
+	const VkMemoryPropertyFlags flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
+		| VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+		| VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+	for (uint32_t i = 0; i < memory_properties->memoryTypeCount; i++) {
+		if ((memory_properties->memoryTypes[i].propertyFlags & flags)
+				== flags) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool has_device_extension(VkPhysicalDevice device,
+		const char *name) {
+	uint32_t count = 0;
+	VkResult res = vkEnumerateDeviceExtensionProperties(device, NULL,
+			&count, NULL);
+	assert(res == VK_SUCCESS);
+
+	VkExtensionProperties *properties =
+		calloc(count, sizeof(VkExtensionProperties));
+	res = vkEnumerateDeviceExtensionProperties(device, NULL, &count,
+			properties);
+	assert(res == VK_SUCCESS);
+
+	bool found = false;
+	for (uint32_t i = 0; i < count; i++) {
+		if (strncmp(properties[i].extensionName, name,
+					VK_MAX_EXTENSION_NAME_SIZE) == 0) {
+			found = true;
+			break;
+		}
+	}
+	free(properties);
+	return found;
+}
+
 static VkResult create_vulkan_instance(VkInstance *instance) {
     VkResult res = VK_ERROR_UNKNOWN;
 
@@ -111,27 +340,71 @@ static VkResult create_vulkan_instance(VkInstance *instance) {
     return res;
 }
 
-static VkResult create_vulkan_device(struct vulkan_ctx *ini) {
+static VkResult create_vulkan_device(struct vulkan_ctx *ini,
+		uint32_t queue_count, bool push_descriptors) {
     int32_t queue_index = find_compute_queue(ini->physical_device);
-    float queue_priority = 1.0;
     assert(queue_index >= 0);
 
     /* cast to uint32_t is safe due to assert */
-    ini->queue_family_index = (uint32_t) queue_index;
+    const uint32_t compute_family = (uint32_t) queue_index;
 
-    VkDeviceQueueCreateInfo queue_create_info = {
-        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-        .queueFamilyIndex = queue_index,
-        .queueCount = 1,
-        .pQueuePriorities = &queue_priority,
+	/* at least one compute queue, at most what the family offers */
+	uint32_t compute_queue_count = queue_count;
+	const uint32_t family_queue_count =
+		get_queue_count(ini->physical_device, compute_family);
+	if (compute_queue_count > family_queue_count) {
+		compute_queue_count = family_queue_count;
+	}
+	if (compute_queue_count > VULKAN_MAX_COMPUTE_QUEUES) {
+		compute_queue_count = VULKAN_MAX_COMPUTE_QUEUES;
+	}
+	if (compute_queue_count == 0) {
+		compute_queue_count = 1;
+	}
+	ini->compute_queue_count = compute_queue_count;
+
+	uint32_t transfer_family = compute_family;
+	uint32_t transfer_index = 0;
+	const bool separate_transfer = find_transfer_queue(ini->physical_device,
+			compute_family, compute_queue_count,
+			&transfer_family, &transfer_index);
+	ini->transfer_concurrent = transfer_family != compute_family;
+
+	float queue_priorities[VULKAN_MAX_COMPUTE_QUEUES + 1];
+	for (size_t i = 0; i < VULKAN_MAX_COMPUTE_QUEUES + 1; i++) {
+		queue_priorities[i] = 1.0;
+	}
+
+    VkDeviceQueueCreateInfo queue_create_infos[] = {
+		{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.queueFamilyIndex = compute_family,
+			.queueCount = separate_transfer && !ini->transfer_concurrent
+				? compute_queue_count + 1 : compute_queue_count,
+			.pQueuePriorities = queue_priorities,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.queueFamilyIndex = transfer_family,
+			.queueCount = 1,
+			.pQueuePriorities = queue_priorities,
+		},
     };
 
-	const char *extensions[] = {};
+	const char *extensions[1];
+	uint32_t extension_count = 0;
+	ini->push_descriptor = push_descriptors
+		&& has_device_extension(ini->physical_device,
+				VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+	if (ini->push_descriptor) {
+		extensions[extension_count++] = VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME;
+	}
+
     VkDeviceCreateInfo device_create_info = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .queueCreateInfoCount = 1,
-        .pQueueCreateInfos = &queue_create_info,
-		.enabledExtensionCount = sizeof(extensions) / sizeof(const char *),
+        .queueCreateInfoCount = ini->transfer_concurrent ? 2 : 1,
+        .pQueueCreateInfos = queue_create_infos,
+		.enabledExtensionCount = extension_count,
 		.ppEnabledExtensionNames = extensions,
     };
 
@@ -146,75 +419,314 @@ static VkResult create_vulkan_device(struct vulkan_ctx *ini) {
         return res;
     }
 
-    vkGetDeviceQueue(ini->device, queue_index, 0, &ini->queue);
+	for (uint32_t i = 0; i < compute_queue_count; i++) {
+		vulkan_queue_init(ini, &ini->compute_queues[i],
+				VULKAN_QUEUE_TYPE_COMPUTE, compute_family, i);
+	}
+	vulkan_queue_init(ini, &ini->transfer, VULKAN_QUEUE_TYPE_TRANSFER,
+			transfer_family, transfer_index);
+
+	if (ini->push_descriptor) {
+		ini->cmd_push_descriptor_set = (PFN_vkCmdPushDescriptorSetKHR)
+			vkGetDeviceProcAddr(ini->device, "vkCmdPushDescriptorSetKHR");
+		assert(ini->cmd_push_descriptor_set != NULL);
+	}
     return res;
 }
 
-struct vulkan_ctx *vulkan_ctx_init(struct vulkan_ctx *ini) {
+/* the data starts with a VkPipelineCacheHeaderVersionOne, which must
+ * match the device for the driver to accept the rest */
+static bool is_valid_pipeline_cache(VkPhysicalDevice device,
+		const void *data, size_t size) {
+	VkPipelineCacheHeaderVersionOne header;
+	if (size < sizeof(header)) {
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(device, &properties);
+	return header.headerSize >= sizeof(header)
+		&& header.headerSize <= size
+		&& header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& header.vendorID == properties.vendorID
+		&& header.deviceID == properties.deviceID
+		&& memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID,
+				VK_UUID_SIZE) == 0;
+}
+
+/* returns the contents of the file at path, or NULL if it can't be read */
+static void *read_pipeline_cache(const char *path, size_t *size) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		return NULL;
+	}
+
+	void *data = NULL;
+	long length = -1;
+	if (fseek(file, 0, SEEK_END) == 0) {
+		length = ftell(file);
+	}
+	if (length > 0 && fseek(file, 0, SEEK_SET) == 0) {
+		data = malloc(length);
+		if (fread(data, 1, length, file) != (size_t) length) {
+			free(data);
+			data = NULL;
+		}
+	}
+	fclose(file);
+
+	*size = length;
+	return data;
+}
+
+static VkResult create_pipeline_cache(struct vulkan_ctx *ini,
+		const char *path) {
+	size_t size = 0;
+	void *data = path != NULL ? read_pipeline_cache(path, &size) : NULL;
+	if (data != NULL && !is_valid_pipeline_cache(ini->physical_device,
+				data, size)) {
+#ifdef VKHEL_DEBUG
+		printf("ignoring pipeline cache %s made for another device\n", path);
+#endif
+		free(data);
+		data = NULL;
+	}
+
+	VkPipelineCacheCreateInfo pipeline_cache_create_info = {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = data != NULL ? size : 0,
+		.pInitialData = data,
+	};
+	VkResult res = vkCreatePipelineCache(ini->device,
+			&pipeline_cache_create_info, NULL, &ini->pipeline_cache);
+	free(data);
+	return res;
+}
+
+/* writes to a temporary file first so that processes sharing the path
+ * never read a partial cache */
+static void save_pipeline_cache(struct vulkan_ctx *ctx) {
+	size_t size = 0;
+	VkResult res = vkGetPipelineCacheData(ctx->device, ctx->pipeline_cache,
+			&size, NULL);
+	assert(res == VK_SUCCESS);
+	void *data = malloc(size);
+	res = vkGetPipelineCacheData(ctx->device, ctx->pipeline_cache,
+			&size, data);
+	assert(res == VK_SUCCESS || res == VK_INCOMPLETE);
+
+	size_t tmp_path_size = strlen(ctx->pipeline_cache_path) + 32;
+	char *tmp_path = malloc(tmp_path_size);
+	snprintf(tmp_path, tmp_path_size, "%s.%ld.tmp",
+			ctx->pipeline_cache_path, (long) getpid());
+
+	FILE *file = fopen(tmp_path, "wb");
+	bool written = false;
+	if (file != NULL) {
+		written = fwrite(data, 1, size, file) == size;
+		written = fclose(file) == 0 && written;
+	}
+	if (!written || rename(tmp_path, ctx->pipeline_cache_path) != 0) {
+#ifdef VKHEL_DEBUG
+		printf("failed to write pipeline cache %s\n",
+				ctx->pipeline_cache_path);
+#endif
+		remove(tmp_path);
+	}
+
+	free(tmp_path);
+	free(data);
+}
+
+struct vulkan_ctx *vulkan_ctx_init(struct vulkan_ctx *ini,
+		const struct vkhel_ctx_options *options) {
     VkResult res = VK_ERROR_UNKNOWN;
 
     res = create_vulkan_instance(&ini->instance);
     assert(res == VK_SUCCESS);
 
-    uint32_t physical_device_count = 1;
-    res = vkEnumeratePhysicalDevices(ini->instance, &physical_device_count,
-			&ini->physical_device);
-    if (res == VK_INCOMPLETE) {
-        fprintf(stderr, "warning: more than one VkPhysicalDevice present\n");
-        res = VK_SUCCESS;
-    }
-    assert(res == VK_SUCCESS);
+	uint32_t physical_device_count = 0;
+	res = vkEnumeratePhysicalDevices(ini->instance, &physical_device_count,
+			NULL);
+	assert(res == VK_SUCCESS);
+	VkPhysicalDevice *physical_devices =
+		calloc(physical_device_count, sizeof(VkPhysicalDevice));
+	res = vkEnumeratePhysicalDevices(ini->instance, &physical_device_count,
+			physical_devices);
+	assert(res == VK_SUCCESS);
+
+	/* device indices count only the devices the kernels can run on; without
+	 * an explicit index the best ranked matching device is used */
+	ini->physical_device = VK_NULL_HANDLE;
+	ini->device_count = 0;
+	int best_rank = -1;
+	for (uint32_t i = 0; i < physical_device_count; i++) {
+		if (!is_suitable_device(physical_devices[i])) {
+			continue;
+		}
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physical_devices[i], &properties);
+		if (options->device_index >= 0) {
+			if (ini->device_count == (uint32_t) options->device_index) {
+				ini->physical_device = physical_devices[i];
+			}
+		} else if (device_matches(&properties, options)
+				&& device_type_rank(properties.deviceType) > best_rank) {
+			ini->physical_device = physical_devices[i];
+			best_rank = device_type_rank(properties.deviceType);
+		}
+		ini->device_count++;
+	}
+	free(physical_devices);
 
+	if (ini->physical_device == VK_NULL_HANDLE) {
+		vkDestroyInstance(ini->instance, NULL);
+		ini->instance = VK_NULL_HANDLE;
+		return NULL;
+	}
+
+#ifdef VKHEL_DEBUG
     VkPhysicalDeviceProperties physical_device_properties;
     vkGetPhysicalDeviceProperties(ini->physical_device,
 			&physical_device_properties);
-    printf("using physical device 0: %s\n",
+    printf("using physical device: %s\n",
 			physical_device_properties.deviceName);
+#endif
 
-    res = create_vulkan_device(ini);
+	VkPhysicalDeviceIDProperties id_properties = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES,
+	};
+	VkPhysicalDeviceProperties2 properties2 = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		.pNext = &id_properties,
+	};
+	vkGetPhysicalDeviceProperties2(ini->physical_device, &properties2);
+	memcpy(ini->device_uuid, id_properties.deviceUUID, VK_UUID_SIZE);
+	ini->max_group_count =
+		properties2.properties.limits.maxComputeWorkGroupCount[0];
+	ini->max_storage_buffer_range =
+		properties2.properties.limits.maxStorageBufferRange;
+	ini->min_storage_buffer_offset_alignment =
+		properties2.properties.limits.minStorageBufferOffsetAlignment;
+
+    res = create_vulkan_device(ini, options->queue_count,
+			options->push_descriptors);
     assert(res == VK_SUCCESS);
 
+	pthread_mutex_init(&ini->lock, NULL);
+	int err = pthread_key_create(&ini->thread_key, vulkan_thread_exit);
+	assert(err == 0);
+	descriptor_cache_init(ini);
+	staging_ring_init(ini);
+
 	vkGetPhysicalDeviceMemoryProperties(ini->physical_device,
 			&ini->memory_properties);
 	ini->device_local_memory_index = find_memory_index(&ini->memory_properties,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 	ini->host_visible_memory_index = find_memory_index(&ini->memory_properties,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	ini->unified_memory = options->host_visible_vectors
+		&& has_unified_memory(&ini->memory_properties);
+
+	/* the budget applies to every heap on its own */
+	VkDeviceSize heap_size_limits[VK_MAX_MEMORY_HEAPS];
+	for (size_t i = 0; i < VK_MAX_MEMORY_HEAPS; i++) {
+		heap_size_limits[i] = options->memory_budget == 0
+			? VK_WHOLE_SIZE : options->memory_budget;
+	}
 
 	VmaAllocatorCreateInfo allocator_create_info = {
 		.physicalDevice = ini->physical_device,
 		.device = ini->device,
 		.instance = ini->instance,
+		.pHeapSizeLimit = heap_size_limits,
 	};
 	res = vmaCreateAllocator(&allocator_create_info, &ini->mem_allocator);
 	assert(res == VK_SUCCESS);
 
-	VkCommandPoolCreateInfo cmd_pool_create_info = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
-		.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
-		.queueFamilyIndex = ini->queue_family_index,
-	};
-	vkCreateCommandPool(ini->device, &cmd_pool_create_info, NULL,
-			&ini->cmd_pool);
+	ini->pipeline_cache = VK_NULL_HANDLE;
+	ini->pipeline_cache_path = NULL;
+	if (options->pipeline_cache) {
+		res = create_pipeline_cache(ini, options->pipeline_cache_path);
+		assert(res == VK_SUCCESS);
+		if (options->pipeline_cache_path != NULL) {
+			ini->pipeline_cache_path = strdup(options->pipeline_cache_path);
+		}
+	}
 
-	/* initialize kernels */
+	/* kernels are created by vulkan_ctx_kernel when first used */
+	pthread_mutex_init(&ini->kernel_lock, NULL);
+	pthread_mutex_init(&ini->prewarm_lock, NULL);
+	ini->prewarming = false;
+	ini->plan_count = 0;
 	for (size_t i = 0; i < VULKAN_KERNEL_TYPE_MAX; i++) {
-		vulkan_kernel_inits[i](ini);
+		ini->kernels[i].ready = false;
+		ini->kernels[i].variants = NULL;
+		ini->kernels[i].retired = NULL;
+		ini->kernels[i].recorded = false;
+		ini->local_sizes[i] = 0;
+		ini->elements_per_invocation[i] = 0;
+	}
+	if (options->tuning_path != NULL) {
+		tuning_load(ini, options->tuning_path);
 	}
 
     return ini;
 }
 
 void vulkan_ctx_finish(struct vulkan_ctx *ctx) {
+	if (ctx->prewarming) {
+		pthread_join(ctx->prewarm_thread, NULL);
+		ctx->prewarming = false;
+	}
+	pthread_mutex_destroy(&ctx->prewarm_lock);
+
+	descriptor_cache_finish(ctx);
+	staging_ring_finish(ctx);
+
 	for (size_t i = 0; i < VULKAN_KERNEL_TYPE_MAX; i++) {
-		vulkan_kernel_finish(ctx, &ctx->kernels[i]);
+		if (ctx->kernels[i].ready) {
+			vulkan_kernel_finish(ctx, &ctx->kernels[i]);
+			ctx->kernels[i].ready = false;
+		}
+	}
+	pthread_mutex_destroy(&ctx->kernel_lock);
+
+	for (size_t i = 0; i < ctx->free_fence_count; i++) {
+		vkDestroyFence(ctx->device, ctx->free_fences[i], NULL);
+	}
+	free(ctx->free_fences);
+
+	/* no destructor may run for this context after the key is gone */
+	pthread_key_delete(ctx->thread_key);
+	while (ctx->threads != NULL) {
+		struct vulkan_thread *thread = ctx->threads;
+		ctx->threads = thread->next;
+		for (size_t i = 0; i < VULKAN_QUEUE_TYPE_MAX; i++) {
+			vulkan_cmd_pool_finish(ctx, &thread->cmd_pools[i]);
+		}
+		free(thread);
 	}
+	ctx->idle_threads = NULL;
+	pthread_mutex_destroy(&ctx->lock);
 
-	vkDestroyCommandPool(ctx->device, ctx->cmd_pool, NULL);
+	for (uint32_t i = 0; i < ctx->compute_queue_count; i++) {
+		pthread_mutex_destroy(&ctx->compute_queues[i].lock);
+		ctx->compute_queues[i].queue = VK_NULL_HANDLE;
+	}
+	pthread_mutex_destroy(&ctx->transfer.lock);
+	ctx->transfer.queue = VK_NULL_HANDLE;
 
+	if (ctx->pipeline_cache_path != NULL) {
+		save_pipeline_cache(ctx);
+		free(ctx->pipeline_cache_path);
+		ctx->pipeline_cache_path = NULL;
+	}
+	vkDestroyPipelineCache(ctx->device, ctx->pipeline_cache, NULL);
 	vmaDestroyAllocator(ctx->mem_allocator);
 
-    ctx->queue = VK_NULL_HANDLE;
     ctx->physical_device = VK_NULL_HANDLE;
 
     vkDestroyDevice(ctx->device, NULL);
@@ -234,33 +746,75 @@ void vulkan_ctx_create_fence(struct vulkan_ctx *vk, VkFence *fence,
 	assert(res == VK_SUCCESS);
 }
 
-void vulkan_ctx_execution_begin(struct vulkan_ctx *vk,
-		struct vulkan_execution *execution, size_t set_count) {
-	VkResult res = VK_ERROR_UNKNOWN;
+VkFence vulkan_ctx_acquire_fence(struct vulkan_ctx *vk) {
+	pthread_mutex_lock(&vk->lock);
+	if (vk->free_fence_count > 0) {
+		VkFence fence = vk->free_fences[--vk->free_fence_count];
+		pthread_mutex_unlock(&vk->lock);
+		return fence;
+	}
+	pthread_mutex_unlock(&vk->lock);
+
+	VkFence fence;
+	vulkan_ctx_create_fence(vk, &fence, false);
+	return fence;
+}
+
+void vulkan_ctx_release_fence(struct vulkan_ctx *vk, VkFence fence) {
+	VkResult res = vkResetFences(vk->device, 1, &fence);
+	assert(res == VK_SUCCESS);
 
-	VkCommandBufferAllocateInfo cmd_buffer_allocate_info = {
+	pthread_mutex_lock(&vk->lock);
+	if (vk->free_fence_count == vk->free_fence_capacity) {
+		vk->free_fence_capacity = vk->free_fence_capacity == 0
+			? 8 : vk->free_fence_capacity * 2;
+		vk->free_fences = realloc(vk->free_fences,
+				vk->free_fence_capacity * sizeof(VkFence));
+		assert(vk->free_fences != NULL);
+	}
+	vk->free_fences[vk->free_fence_count++] = fence;
+	pthread_mutex_unlock(&vk->lock);
+}
+
+static VkCommandBuffer acquire_cmd_buffer(struct vulkan_ctx *vk,
+		struct vulkan_cmd_pool *pool) {
+	pthread_mutex_lock(&pool->lock);
+	if (pool->free_cmd_buffer_count > 0) {
+		VkCommandBuffer cmd_buffer =
+			pool->free_cmd_buffers[--pool->free_cmd_buffer_count];
+		pthread_mutex_unlock(&pool->lock);
+		return cmd_buffer;
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	/* only the owning thread allocates from the pool */
+	VkCommandBufferAllocateInfo allocate_info = {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.commandPool = vk->cmd_pool,
+		.commandPool = pool->cmd_pool,
 		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
 		.commandBufferCount = 1,
 	};
-	res = vkAllocateCommandBuffers(vk->device, &cmd_buffer_allocate_info,
-			&execution->cmd_buffer);
+	VkCommandBuffer cmd_buffer;
+	VkResult res = vkAllocateCommandBuffers(vk->device, &allocate_info,
+			&cmd_buffer);
 	assert(res == VK_SUCCESS);
+	return cmd_buffer;
+}
 
-	VkDescriptorPoolCreateInfo descriptor_pool_create_info = {
-		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-		.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
-		.maxSets = set_count,
-		.poolSizeCount = 1,
-		.pPoolSizes = &(const VkDescriptorPoolSize) {
-			.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			.descriptorCount = 3 * set_count,
-		},
-	};
-	res = vkCreateDescriptorPool(vk->device, &descriptor_pool_create_info,
-			NULL, &execution->descriptor_pool);
-	assert(res == VK_SUCCESS);
+struct vulkan_queue *vulkan_ctx_queue(struct vulkan_ctx *vk,
+		enum vulkan_queue_type type) {
+	return vulkan_ctx_thread(vk)->queues[type];
+}
+
+void vulkan_ctx_execution_begin(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution, enum vulkan_queue_type type) {
+	VkResult res = VK_ERROR_UNKNOWN;
+
+	struct vulkan_thread *thread = vulkan_ctx_thread(vk);
+	execution->queue = thread->queues[type];
+	execution->cmd_pool = &thread->cmd_pools[type];
+	execution->cmd_buffer = acquire_cmd_buffer(vk, execution->cmd_pool);
+	execution->prerecorded = false;
 
 	VkCommandBufferBeginInfo begin_info = {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -270,11 +824,46 @@ void vulkan_ctx_execution_begin(struct vulkan_ctx *vk,
 	assert(res == VK_SUCCESS);
 }
 
+void vulkan_ctx_execution_barrier(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution) {
+	/* make writes of previously recorded dispatches and copies visible to
+	 * the next ones */
+	const VkMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT
+			| VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+			| VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+	};
+	const VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+		| VK_PIPELINE_STAGE_TRANSFER_BIT;
+	vkCmdPipelineBarrier(execution->cmd_buffer, stages, stages,
+			0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+void vulkan_ctx_execution_host_barrier(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution) {
+	/* the fence alone does not make device writes available to the host,
+	 * which reads mapped vectors and staging chunks once it signals */
+	const VkMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT
+			| VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+	};
+	vkCmdPipelineBarrier(execution->cmd_buffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+			| VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
 void vulkan_ctx_execution_end(struct vulkan_ctx *vk,
 		struct vulkan_execution *execution,
 		VkFence fence) {
 	VkResult res = VK_ERROR_UNKNOWN;
 
+	vulkan_ctx_execution_host_barrier(vk, execution);
+
 	res = vkEndCommandBuffer(execution->cmd_buffer);
 	assert(res == VK_SUCCESS);
 
@@ -283,5 +872,467 @@ void vulkan_ctx_execution_end(struct vulkan_ctx *vk,
 		.commandBufferCount = 1,
 		.pCommandBuffers = &execution->cmd_buffer,
 	};
-	vkQueueSubmit(vk->queue, 1, &submit_info, fence);
+	res = vulkan_queue_submit(execution->queue, &submit_info, fence);
+	assert(res == VK_SUCCESS);
+}
+
+VkResult vulkan_queue_submit(struct vulkan_queue *queue,
+		const VkSubmitInfo *submit_info, VkFence fence) {
+	pthread_mutex_lock(queue->submit_lock);
+	VkResult res = vkQueueSubmit(queue->queue, 1, submit_info, fence);
+	pthread_mutex_unlock(queue->submit_lock);
+	return res;
+}
+
+void vulkan_ctx_execution_finish(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution) {
+	struct vulkan_cmd_pool *pool = execution->cmd_pool;
+	pthread_mutex_lock(&pool->lock);
+	if (pool->free_cmd_buffer_count == pool->free_cmd_buffer_capacity) {
+		pool->free_cmd_buffer_capacity = pool->free_cmd_buffer_capacity == 0
+			? 8 : pool->free_cmd_buffer_capacity * 2;
+		pool->free_cmd_buffers = realloc(pool->free_cmd_buffers,
+				pool->free_cmd_buffer_capacity * sizeof(VkCommandBuffer));
+		assert(pool->free_cmd_buffers != NULL);
+	}
+	pool->free_cmd_buffers[pool->free_cmd_buffer_count++] =
+		execution->cmd_buffer;
+	pthread_mutex_unlock(&pool->lock);
+	execution->cmd_buffer = VK_NULL_HANDLE;
+}
+
+void vulkan_ctx_execution_submit_wait(struct vulkan_ctx *vk,
+		struct vulkan_execution *execution) {
+	VkFence fence = vulkan_ctx_acquire_fence(vk);
+	vulkan_ctx_execution_end(vk, execution, fence);
+
+	VkResult res = vkWaitForFences(vk->device, 1, &fence, true, -1);
+	assert(res == VK_SUCCESS);
+
+	vulkan_ctx_release_fence(vk, fence);
+	vulkan_ctx_execution_finish(vk, execution);
+}
+
+uint32_t vulkan_ctx_group_count(const struct vulkan_ctx *vk,
+		uint64_t invocations, uint32_t local_size) {
+	const uint64_t groups = (invocations + local_size - 1) / local_size;
+	return groups > vk->max_group_count ? vk->max_group_count : groups;
+}
+
+struct vulkan_kernel *vulkan_ctx_kernel(struct vulkan_ctx *vk,
+		enum vulkan_kernel_type type) {
+	struct vulkan_kernel *kernel = &vk->kernels[type];
+	if (__atomic_load_n(&kernel->ready, __ATOMIC_ACQUIRE)) {
+		return kernel;
+	}
+
+	pthread_mutex_lock(&vk->kernel_lock);
+	if (!kernel->ready) {
+		vulkan_kernel_inits[type](vk);
+		__atomic_store_n(&kernel->ready, true, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&vk->kernel_lock);
+	return kernel;
+}
+
+/* kernels whose shaders take the constants below */
+static const enum vulkan_kernel_type specializable_kernels[] = {
+	VULKAN_KERNEL_TYPE_ELEMFMA,
+	VULKAN_KERNEL_TYPE_ELEMMUL,
+	VULKAN_KERNEL_TYPE_ELEMGTSUB,
+	VULKAN_KERNEL_TYPE_ELEMMULCONST,
+};
+
+/* constant ids in the shaders; an id a shader doesn't declare is ignored.
+ * 0 and 4 shape the kernel, 1 to 3 fix its modulus */
+struct specialization_data {
+	uint32_t local_size;
+	VkBool32 load_pairs;
+	uint64_t mod;
+	uint64_t barrett_factor;
+	uint64_t n;
+};
+
+static const VkSpecializationMapEntry specialization_entries[] = {
+	{
+		.constantID = 0,
+		.offset = offsetof(struct specialization_data, local_size),
+		.size = sizeof(uint32_t),
+	},
+	{
+		.constantID = 4,
+		.offset = offsetof(struct specialization_data, load_pairs),
+		.size = sizeof(VkBool32),
+	},
+	{
+		.constantID = 1,
+		.offset = offsetof(struct specialization_data, mod),
+		.size = sizeof(uint64_t),
+	},
+	{
+		.constantID = 2,
+		.offset = offsetof(struct specialization_data, barrett_factor),
+		.size = sizeof(uint64_t),
+	},
+	{
+		.constantID = 3,
+		.offset = offsetof(struct specialization_data, n),
+		.size = sizeof(uint64_t),
+	},
+};
+
+#define SHAPE_ENTRY_COUNT 2
+
+static VkResult create_specialized_pipeline(struct vulkan_ctx *vk,
+		const struct vulkan_kernel *kernel, uint32_t entry_count,
+		const struct specialization_data *data, VkPipeline *pipeline) {
+	const VkSpecializationInfo specialization_info = {
+		.mapEntryCount = entry_count,
+		.pMapEntries = specialization_entries,
+		.dataSize = sizeof(struct specialization_data),
+		.pData = data,
+	};
+	VkComputePipelineCreateInfo pipeline_create_info = {
+		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.stage = {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.module = kernel->shader,
+			.pName = "main",
+			.pSpecializationInfo = &specialization_info,
+		},
+		.layout = kernel->pipeline_layout,
+	};
+	return vkCreateComputePipelines(vk->device, vk->pipeline_cache, 1,
+			&pipeline_create_info, NULL, pipeline);
+}
+
+VkResult vulkan_kernel_create_pipeline(struct vulkan_ctx *vk,
+		enum vulkan_kernel_type type, uint32_t shader_local_size) {
+	struct vulkan_kernel *kernel = &vk->kernels[type];
+	kernel->local_size = vk->local_sizes[type] != 0
+		? vk->local_sizes[type] : shader_local_size;
+	kernel->elements_per_invocation =
+		vk->elements_per_invocation[type] != 0
+		? vk->elements_per_invocation[type] : 1;
+
+	kernel->scalar_pipeline = VK_NULL_HANDLE;
+
+	const struct specialization_data data = {
+		.local_size = kernel->local_size,
+		.load_pairs = kernel->elements_per_invocation > 1,
+	};
+	return create_specialized_pipeline(vk, kernel, SHAPE_ENTRY_COUNT, &data,
+			&kernel->pipeline);
+}
+
+VkPipeline vulkan_kernel_scalar_pipeline(struct vulkan_ctx *vk,
+		struct vulkan_kernel *kernel) {
+	VkPipeline pipeline =
+		__atomic_load_n(&kernel->scalar_pipeline, __ATOMIC_ACQUIRE);
+	if (pipeline != VK_NULL_HANDLE) {
+		return pipeline;
+	}
+
+	pthread_mutex_lock(&vk->kernel_lock);
+	if (kernel->scalar_pipeline == VK_NULL_HANDLE) {
+		const struct specialization_data data = {
+			.local_size = kernel->local_size,
+			.load_pairs = false,
+		};
+		VkResult res = create_specialized_pipeline(vk, kernel,
+				SHAPE_ENTRY_COUNT, &data, &pipeline);
+		assert(res == VK_SUCCESS);
+		__atomic_store_n(&kernel->scalar_pipeline, pipeline,
+				__ATOMIC_RELEASE);
+	}
+	pipeline = kernel->scalar_pipeline;
+	pthread_mutex_unlock(&vk->kernel_lock);
+	return pipeline;
+}
+
+static VkResult create_variant_pipeline(struct vulkan_ctx *vk,
+		const struct vulkan_kernel *kernel,
+		struct vulkan_kernel_variant *variant) {
+	/* the same factor the kernels push for a plain reduction */
+	const uint64_t mod_bits = nt_ceil_log2(variant->mod);
+	const struct specialization_data data = {
+		.local_size = variant->local_size,
+		.load_pairs = variant->elements_per_invocation > 1,
+		.mod = variant->mod,
+		.barrett_factor = nt_compute_barrett_factor(
+				(uint64_t) 1 << (mod_bits + nt_alpha - 64),
+				variant->mod, mod_bits),
+		.n = mod_bits,
+	};
+	return create_specialized_pipeline(vk, kernel,
+			sizeof(specialization_entries) / sizeof(VkSpecializationMapEntry),
+			&data, &variant->pipeline);
+}
+
+/* destroys the pipeline, or keeps it until the last plan is gone if one
+ * may have recorded it */
+static void retire_pipeline(struct vulkan_ctx *vk,
+		struct vulkan_kernel *kernel, VkPipeline pipeline) {
+	if (pipeline == VK_NULL_HANDLE) {
+		return;
+	}
+	if (!kernel->recorded || vk->plan_count == 0) {
+		vkDestroyPipeline(vk->device, pipeline, NULL);
+		return;
+	}
+	struct vulkan_retired_pipeline *retired = malloc(sizeof(*retired));
+	assert(retired != NULL);
+	retired->pipeline = pipeline;
+	retired->next = kernel->retired;
+	kernel->retired = retired;
+}
+
+void vulkan_ctx_set_kernel_shape(struct vulkan_ctx *vk,
+		enum vulkan_kernel_type type, uint32_t local_size,
+		uint32_t elements_per_invocation) {
+	assert(local_size != 0);
+	assert(elements_per_invocation != 0);
+	pthread_mutex_lock(&vk->kernel_lock);
+	vk->local_sizes[type] = local_size;
+	vk->elements_per_invocation[type] = elements_per_invocation;
+
+	/* an unbuilt kernel picks the shape up when it is first used */
+	struct vulkan_kernel *kernel = &vk->kernels[type];
+	if (kernel->ready) {
+		/* NTT plans keep the pipelines they were recorded with */
+		retire_pipeline(vk, kernel, kernel->pipeline);
+		retire_pipeline(vk, kernel, kernel->scalar_pipeline);
+		VkResult res = vulkan_kernel_create_pipeline(vk, type, local_size);
+		assert(res == VK_SUCCESS);
+
+		/* variants follow the new shape; of those for one modulus only the
+		 * newest, the one dispatched, is kept */
+		struct vulkan_kernel_variant **link = &kernel->variants;
+		while (*link != NULL) {
+			struct vulkan_kernel_variant *variant = *link;
+			retire_pipeline(vk, kernel, variant->pipeline);
+			bool shadowed = false;
+			for (const struct vulkan_kernel_variant *newer = kernel->variants;
+					newer != variant; newer = newer->next) {
+				shadowed |= newer->mod == variant->mod;
+			}
+			if (shadowed) {
+				*link = variant->next;
+				free(variant);
+				continue;
+			}
+
+			if (!variant->fixed_local_size) {
+				variant->local_size = kernel->local_size;
+			}
+			variant->elements_per_invocation = kernel->elements_per_invocation;
+			res = create_variant_pipeline(vk, kernel, variant);
+			assert(res == VK_SUCCESS);
+			link = &variant->next;
+		}
+		kernel->recorded = false;
+	}
+	pthread_mutex_unlock(&vk->kernel_lock);
+}
+
+void vulkan_ctx_plan_acquire(struct vulkan_ctx *vk) {
+	pthread_mutex_lock(&vk->kernel_lock);
+	vk->plan_count++;
+	pthread_mutex_unlock(&vk->kernel_lock);
+}
+
+void vulkan_ctx_plan_release(struct vulkan_ctx *vk) {
+	pthread_mutex_lock(&vk->kernel_lock);
+	assert(vk->plan_count > 0);
+	if (--vk->plan_count == 0) {
+		for (size_t i = 0; i < VULKAN_KERNEL_TYPE_MAX; i++) {
+			free_retired_pipelines(vk, &vk->kernels[i]);
+		}
+	}
+	pthread_mutex_unlock(&vk->kernel_lock);
+}
+
+const struct vulkan_kernel_variant *vulkan_kernel_find_variant(
+		const struct vulkan_kernel *kernel, uint64_t mod) {
+	const struct vulkan_kernel_variant *variant =
+		__atomic_load_n(&kernel->variants, __ATOMIC_ACQUIRE);
+	for (; variant != NULL; variant = variant->next) {
+		if (variant->mod == mod && variant->elements_per_invocation
+				== kernel->elements_per_invocation
+				&& (variant->fixed_local_size
+					|| variant->local_size == kernel->local_size)) {
+			return variant;
+		}
+	}
+	return NULL;
+}
+
+void vulkan_ctx_specialize(struct vulkan_ctx *vk, uint64_t mod,
+		uint32_t local_size) {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(vk->physical_device, &properties);
+	assert(local_size <= properties.limits.maxComputeWorkGroupSize[0]);
+	assert(local_size <= properties.limits.maxComputeWorkGroupInvocations);
+
+	for (size_t i = 0; i < sizeof(specializable_kernels)
+			/ sizeof(enum vulkan_kernel_type); i++) {
+		struct vulkan_kernel *kernel =
+			vulkan_ctx_kernel(vk, specializable_kernels[i]);
+
+		pthread_mutex_lock(&vk->kernel_lock);
+		/* already the one dispatched for mod */
+		const struct vulkan_kernel_variant *current =
+			vulkan_kernel_find_variant(kernel, mod);
+		if (current != NULL && current->fixed_local_size == (local_size != 0)
+				&& (local_size == 0 || current->local_size == local_size)) {
+			pthread_mutex_unlock(&vk->kernel_lock);
+			continue;
+		}
+
+		struct vulkan_kernel_variant *variant =
+			calloc(1, sizeof(struct vulkan_kernel_variant));
+		assert(variant != NULL);
+		variant->mod = mod;
+		variant->local_size = local_size != 0 ? local_size : kernel->local_size;
+		variant->elements_per_invocation = kernel->elements_per_invocation;
+		variant->fixed_local_size = local_size != 0;
+		VkResult res = create_variant_pipeline(vk, kernel, variant);
+		assert(res == VK_SUCCESS);
+
+		variant->next = kernel->variants;
+		__atomic_store_n(&kernel->variants, variant, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&vk->kernel_lock);
+	}
+}
+
+bool vulkan_kernel_pair_aligned(const VkDescriptorBufferInfo *buffers,
+		size_t buffer_count) {
+	for (size_t i = 0; i < buffer_count; i++) {
+		if (buffers[i].offset % (2 * sizeof(uint64_t)) != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void vulkan_kernel_dispatch(struct vulkan_ctx *vk,
+		struct vulkan_kernel *kernel, struct vulkan_execution *execution,
+		const VkDescriptorBufferInfo *buffers, size_t buffer_count,
+		uint64_t mod, uint64_t length) {
+	VkPipeline pipeline = kernel->pipeline;
+	uint32_t local_size = kernel->local_size;
+	uint32_t elements_per_invocation = kernel->elements_per_invocation;
+
+	const struct vulkan_kernel_variant *variant =
+		vulkan_kernel_find_variant(kernel, mod);
+	if (variant != NULL) {
+		pipeline = variant->pipeline;
+		local_size = variant->local_size;
+		elements_per_invocation = variant->elements_per_invocation;
+	}
+
+	/* the scalar pipeline reads the modulus from the push constants like
+	 * the generic one, so it stands in for variants too */
+	if (elements_per_invocation > 1 && !vulkan_kernel_pair_aligned(buffers, buffer_count)) {
+		pipeline = vulkan_kernel_scalar_pipeline(vk, kernel);
+		local_size = kernel->local_size;
+		elements_per_invocation = 1;
+	}
+
+	if (execution->prerecorded) {
+		__atomic_store_n(&kernel->recorded, true, __ATOMIC_RELAXED);
+	}
+	vkCmdBindPipeline(execution->cmd_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+			pipeline);
+	const uint64_t invocations = (length + elements_per_invocation - 1)
+		/ elements_per_invocation;
+	vkCmdDispatch(execution->cmd_buffer,
+			vulkan_ctx_group_count(vk, invocations, local_size), 1, 1);
+}
+
+static void prewarm_kernels(struct vulkan_ctx *vk, uint32_t kernels) {
+	for (size_t i = 0; i < VULKAN_KERNEL_TYPE_MAX; i++) {
+		if (kernels & (1u << i)) {
+			vulkan_ctx_kernel(vk, i);
+		}
+	}
+}
+
+static void *prewarm_thread(void *data) {
+	struct vulkan_ctx *vk = data;
+	prewarm_kernels(vk, vk->prewarm_kernels);
+	return NULL;
+}
+
+void vulkan_ctx_prewarm(struct vulkan_ctx *vk, uint32_t kernels,
+		bool background) {
+	if (!background) {
+		prewarm_kernels(vk, kernels);
+		return;
+	}
+
+	pthread_mutex_lock(&vk->prewarm_lock);
+	if (vk->prewarming) {
+		pthread_join(vk->prewarm_thread, NULL);
+	}
+	vk->prewarm_kernels = kernels;
+	int err = pthread_create(&vk->prewarm_thread, NULL, prewarm_thread, vk);
+	assert(err == 0);
+	vk->prewarming = true;
+	pthread_mutex_unlock(&vk->prewarm_lock);
+}
+
+VkResult vulkan_ctx_create_set_layout(struct vulkan_ctx *vk,
+		const VkDescriptorSetLayoutCreateInfo *create_info,
+		VkDescriptorSetLayout *set_layout) {
+	VkDescriptorSetLayoutCreateInfo info = *create_info;
+	if (vk->push_descriptor) {
+		info.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR;
+	}
+	return vkCreateDescriptorSetLayout(vk->device, &info, NULL, set_layout);
+}
+
+uint32_t vulkan_kernel_fill_writes(const struct vulkan_kernel *kernel,
+		VkDescriptorSet set, const VkDescriptorBufferInfo *buffers,
+		size_t buffer_count, VkWriteDescriptorSet *writes) {
+	/* array bindings consume several consecutive buffers */
+	size_t consumed = 0;
+	for (uint32_t i = 0; i < kernel->binding_count; i++) {
+		const VkDescriptorSetLayoutBinding *binding = &kernel->bindings[i];
+		writes[i] = (VkWriteDescriptorSet) {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = set,
+			.dstBinding = binding->binding,
+			.dstArrayElement = 0,
+			.descriptorType = binding->descriptorType,
+			.descriptorCount = binding->descriptorCount,
+			.pBufferInfo = &buffers[consumed],
+		};
+		consumed += binding->descriptorCount;
+	}
+	assert(consumed == buffer_count);
+
+	return kernel->binding_count;
+}
+
+void vulkan_kernel_bind_buffers(struct vulkan_ctx *vk,
+		const struct vulkan_kernel *kernel,
+		struct vulkan_execution *execution,
+		const VkDescriptorBufferInfo *buffers, size_t buffer_count) {
+	if (vk->push_descriptor) {
+		VkWriteDescriptorSet writes[DESCRIPTOR_CACHE_MAX_BUFFERS];
+		const uint32_t write_count = vulkan_kernel_fill_writes(kernel,
+				VK_NULL_HANDLE, buffers, buffer_count, writes);
+		vk->cmd_push_descriptor_set(execution->cmd_buffer,
+				VK_PIPELINE_BIND_POINT_COMPUTE, kernel->pipeline_layout,
+				0, write_count, writes);
+		return;
+	}
+
+	VkDescriptorSet descriptor_set = descriptor_cache_get(vk, kernel,
+			buffers, buffer_count);
+	vkCmdBindDescriptorSets(execution->cmd_buffer,
+			VK_PIPELINE_BIND_POINT_COMPUTE,
+			kernel->pipeline_layout, 0, 1, &descriptor_set, 0, NULL);
 }
@@ -1,7 +1,12 @@
 #include <assert.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <vkhel.h>
+#include "priv/kernels/elemmulconst.h"
+#include "priv/ntt_tables.h"
+#include "priv/vkhel.h"
 
 #define RUN_TEST(name) ({\
 		test_##name();\
@@ -12,14 +17,50 @@ static struct vkhel_ctx *g_ctx;
 
 static void assert_vector_contents_equal(struct vkhel_vector *vec,
 		const uint64_t *contents, size_t length) {
-	uint64_t *mapped;
-	vkhel_vector_map(vec, (void **) &mapped, sizeof(uint64_t) * length);
+	const uint64_t *mapped = vkhel_vector_map_range(vec, 0,
+			sizeof(uint64_t) * length, VKHEL_MAP_READ);
 	for (size_t i = 0; i < length; i++) {
 		assert(mapped[i] == contents[i]);
 	}
 	vkhel_vector_unmap(vec);
 }
 
+/* odd and above every local size the kernels are built with, so several
+ * groups run and the last pair is split */
+#define CHECK_ELEMMUL_LENGTH 4097
+
+/* { 1, 2, 3, ... } times { 5, 6, 7, ... } modulo mod, checked against the
+ * host; the product is computed twice so the second dispatch goes
+ * through any descriptor set cached by the first */
+static void check_elemmul(struct vkhel_ctx *ctx, size_t length,
+		uint64_t mod) {
+	uint64_t *a_elements = malloc(length * sizeof(uint64_t));
+	uint64_t *b_elements = malloc(length * sizeof(uint64_t));
+	uint64_t *expected = malloc(length * sizeof(uint64_t));
+	assert(a_elements != NULL && b_elements != NULL && expected != NULL);
+	for (size_t i = 0; i < length; i++) {
+		a_elements[i] = i + 1;
+		b_elements[i] = i + 5;
+		expected[i] = a_elements[i] * b_elements[i] % mod;
+	}
+
+	struct vkhel_vector *a = vkhel_vector_create(ctx, length);
+	vkhel_vector_copy_from_host(a, a_elements);
+	struct vkhel_vector *b = vkhel_vector_create(ctx, length);
+	vkhel_vector_copy_from_host(b, b_elements);
+	struct vkhel_vector *c = vkhel_vector_create(ctx, length);
+	vkhel_vector_elemmul(a, b, c, mod);
+	vkhel_vector_elemmul(a, b, c, mod);
+	assert_vector_contents_equal(c, expected, length);
+
+	vkhel_vector_destroy(a);
+	vkhel_vector_destroy(b);
+	vkhel_vector_destroy(c);
+	free(a_elements);
+	free(b_elements);
+	free(expected);
+}
+
 void test_copy_from_host() {
 	const size_t vector_len = 10;
 	uint64_t elements[vector_len];
@@ -285,10 +326,10 @@ void test_inverse_transform() {
 void test_forward_transform_big() {
 	const uint64_t elements_len = 16;
 	const uint64_t elements[16] = {
-		2251799813685306, 2251799813685310, 2251799813685308, 2251799813685312, 2251799813685311, 0, 2251799813685302, 2251799813685310, 2251799813685312, 2251799813685310, 2, 2251799813685311, 0, 2251799813685309, 2251799813685311, 2251799813685306,
+	2251799813685306, 2251799813685310, 2251799813685308, 2251799813685312, 2251799813685311, 0, 2251799813685302, 2251799813685310, 2251799813685312, 2251799813685310, 2, 2251799813685311, 0, 2251799813685309, 2251799813685311, 2251799813685306,
 	};
 	const uint64_t expected[16] = {
-		610434879442967, 613666103418554, 2249249381734859, 2053490208846177, 1522677317362741, 1551865907717647, 270569269564721, 1037126332549088, 1045941308259958, 1600925533406968, 1522209320066420, 282301763365150, 1026564520130301, 2172754229003974, 87881069444854, 366741365168013,
+	610434879442967, 613666103418554, 2249249381734859, 2053490208846177, 1522677317362741, 1551865907717647, 270569269564721, 1037126332549088, 1045941308259958, 1600925533406968, 1522209320066420, 282301763365150, 1026564520130301, 2172754229003974, 87881069444854, 366741365168013,
 	};
 
 	struct vkhel_ntt_tables *ntt = vkhel_ntt_tables_create(
@@ -308,10 +349,10 @@ void test_forward_transform_big() {
 void test_inverse_transform_big() {
 	const uint64_t elements_len = 16;
 	const uint64_t elements[16] = {
-		610434879442967, 613666103418554, 2249249381734859, 2053490208846177, 1522677317362741, 1551865907717647, 270569269564721, 1037126332549088, 1045941308259958, 1600925533406968, 1522209320066420, 282301763365150, 1026564520130301, 2172754229003974, 87881069444854, 366741365168013,
+	610434879442967, 613666103418554, 2249249381734859, 2053490208846177, 1522677317362741, 1551865907717647, 270569269564721, 1037126332549088, 1045941308259958, 1600925533406968, 1522209320066420, 282301763365150, 1026564520130301, 2172754229003974, 87881069444854, 366741365168013,
 	};
 	const uint64_t expected[16] = {
-		2251799813685306, 2251799813685310, 2251799813685308, 2251799813685312, 2251799813685311, 0, 2251799813685302, 2251799813685310, 2251799813685312, 2251799813685310, 2, 2251799813685311, 0, 2251799813685309, 2251799813685311, 2251799813685306,
+	2251799813685306, 2251799813685310, 2251799813685308, 2251799813685312, 2251799813685311, 0, 2251799813685302, 2251799813685310, 2251799813685312, 2251799813685310, 2, 2251799813685311, 0, 2251799813685309, 2251799813685311, 2251799813685306,
 	};
 
 	struct vkhel_ntt_tables *ntt = vkhel_ntt_tables_create(
@@ -328,6 +369,981 @@ void test_inverse_transform_big() {
 	vkhel_ntt_tables_destroy(ntt);
 }
 
+static void reference_forward_transform(const struct vkhel_ntt_tables *ntt,
+		uint64_t *elements) {
+	uint64_t t = ntt->n / 2;
+	for (uint64_t m = 1; m < ntt->n; m *= 2, t /= 2) {
+		for (uint64_t i = 0; i < m; i++) {
+			const uint64_t w = ntt->roots_of_unity[m + i];
+			for (uint64_t j = 2 * i * t; j < 2 * i * t + t; j++) {
+				const uint64_t x = elements[j];
+				const uint64_t wy =
+					((unsigned __int128) w * elements[j + t]) % ntt->q;
+				elements[j] = (x + wy) % ntt->q;
+				elements[j + t] = (x + ntt->q - wy) % ntt->q;
+			}
+		}
+	}
+}
+
+/* large enough for the first stages to run outside the fused kernel */
+void test_transform_large() {
+	const uint64_t elements_len = 4096;
+	const uint64_t modulus = 1125899906949121;
+	uint64_t elements[elements_len];
+	uint64_t expected[elements_len];
+
+	uint64_t seed = 1;
+	for (size_t i = 0; i < elements_len; i++) {
+		seed = seed * 6364136223846793005 + 1442695040888963407;
+		elements[i] = (seed >> 11) % modulus;
+		expected[i] = elements[i];
+	}
+
+	struct vkhel_ntt_tables *ntt = vkhel_ntt_tables_create(
+		elements_len, /* degree */
+		modulus, /* modulus */
+		777822262577257 /* omega */
+	);
+	reference_forward_transform(ntt, expected);
+
+	struct vkhel_vector *a = vkhel_vector_create2(g_ctx, elements_len, false);
+	vkhel_vector_copy_from_host(a, elements);
+
+	struct vkhel_vector *b = vkhel_vector_create2(g_ctx, elements_len, false);
+	vkhel_vector_forward_transform(a, b, ntt);
+	assert_vector_contents_equal(b, expected, elements_len);
+
+	vkhel_vector_inverse_transform(b, b, ntt);
+	assert_vector_contents_equal(b, elements, elements_len);
+
+	vkhel_vector_destroy(a);
+	vkhel_vector_destroy(b);
+	vkhel_ntt_tables_destroy(ntt);
+}
+
+void test_elemmul_huge() {
+	/* more elements than 65535 groups of 64 invocations cover */
+	const uint64_t elements_len = (uint64_t) 1 << 23;
+	const uint64_t modulus = 1125899906949121;
+	uint64_t *a_elements = malloc(elements_len * sizeof(uint64_t));
+	uint64_t *b_elements = malloc(elements_len * sizeof(uint64_t));
+	for (size_t i = 0; i < elements_len; i++) {
+		a_elements[i] = i;
+		b_elements[i] = 3;
+	}
+
+	struct vkhel_vector *a = vkhel_vector_create(g_ctx, elements_len);
+	vkhel_vector_copy_from_host(a, a_elements);
+	struct vkhel_vector *b = vkhel_vector_create(g_ctx, elements_len);
+	vkhel_vector_copy_from_host(b, b_elements);
+	vkhel_vector_elemmul(a, b, a, modulus);
+
+	for (size_t i = 0; i < elements_len; i++) {
+		a_elements[i] = 3 * i;
+	}
+	assert_vector_contents_equal(a, a_elements, elements_len);
+
+	vkhel_vector_destroy(a);
+	vkhel_vector_destroy(b);
+	free(a_elements);
+	free(b_elements);
+}
+
+/* a 16 point transform modulo 2251799813685313 and its result, for the
+ * plan tests */
+static const uint64_t plan_elements[16] = {
+	2251799813685306, 2251799813685310, 2251799813685308, 2251799813685312, 2251799813685311, 0, 2251799813685302, 2251799813685310, 2251799813685312, 2251799813685310, 2, 2251799813685311, 0, 2251799813685309, 2251799813685311, 2251799813685306,
+};
+static const uint64_t plan_expected[16] = {
+	610434879442967, 613666103418554, 2249249381734859, 2053490208846177, 1522677317362741, 1551865907717647, 270569269564721, 1037126332549088, 1045941308259958, 1600925533406968, 1522209320066420, 282301763365150, 1026564520130301, 2172754229003974, 87881069444854, 366741365168013,
+};
+
+static struct vkhel_ntt_tables *create_plan_tables() {
+	return vkhel_ntt_tables_create(
+		16, /* degree */
+		2251799813685313, /* modulus */
+		110968848420801 /* omega */
+	);
+}
+
+void test_ntt_plan() {
+	const uint64_t elements_len = 16;
+	const uint64_t *elements = plan_elements;
+	const uint64_t *expected = plan_expected;
+
+	struct vkhel_ntt_tables *ntt = create_plan_tables();
+
+	struct vkhel_vector *vec = vkhel_vector_create2(g_ctx, elements_len, false);
+	struct vkhel_ntt_plan *plan = vkhel_ntt_plan_create(ntt, vec, vec);
+
+	/* uploading the tables to another context leaves the buffers the plan
+	 * recorded alone */
+	struct vkhel_ctx *other_ctx = vkhel_ctx_create();
+	struct vkhel_vector *other = vkhel_vector_create(other_ctx, elements_len);
+	vkhel_vector_copy_from_host(other, elements);
+	vkhel_vector_forward_transform(other, other, ntt);
+	assert_vector_contents_equal(other, expected, elements_len);
+	vkhel_vector_destroy(other);
+
+	/* the recorded command buffers are reused across runs */
+	for (size_t i = 0; i < 3; i++) {
+		vkhel_vector_copy_from_host(vec, elements);
+		vkhel_ntt_plan_forward(plan);
+		assert_vector_contents_equal(vec, expected, elements_len);
+		vkhel_ntt_plan_inverse(plan);
+		assert_vector_contents_equal(vec, elements, elements_len);
+	}
+
+	vkhel_ntt_plan_destroy(plan);
+	vkhel_vector_destroy(vec);
+	vkhel_ntt_tables_destroy(ntt);
+	vkhel_ctx_destroy(other_ctx);
+}
+
+static void *plan_worker(void *data) {
+	struct vkhel_ntt_plan *plan = data;
+	for (size_t i = 0; i < 16; i++) {
+		vkhel_ntt_plan_forward(plan);
+	}
+	return NULL;
+}
+
+void test_ntt_plan_threads() {
+	/* out of place, so every run writes the same result */
+	struct vkhel_ntt_tables *ntt = create_plan_tables();
+	struct vkhel_vector *operand = vkhel_vector_create(g_ctx, 16);
+	vkhel_vector_copy_from_host(operand, plan_elements);
+	struct vkhel_vector *result = vkhel_vector_create(g_ctx, 16);
+	struct vkhel_ntt_plan *plan = vkhel_ntt_plan_create(ntt, operand, result);
+
+	pthread_t threads[4];
+	for (size_t i = 0; i < 4; i++) {
+		int err = pthread_create(&threads[i], NULL, plan_worker, plan);
+		assert(err == 0);
+	}
+	for (size_t i = 0; i < 4; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	assert_vector_contents_equal(result, plan_expected, 16);
+
+	vkhel_ntt_plan_destroy(plan);
+	vkhel_vector_destroy(operand);
+	vkhel_vector_destroy(result);
+	vkhel_ntt_tables_destroy(ntt);
+}
+
+void test_batch() {
+	const size_t vector_len = 8;
+	const uint64_t a_elements[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	const uint64_t b_elements[] = { 9, 10, 11, 12, 13, 14, 15, 16 };
+	const uint64_t modulus = 769;
+
+	struct vkhel_vector *a = vkhel_vector_create(g_ctx, vector_len);
+	vkhel_vector_copy_from_host(a, a_elements);
+	struct vkhel_vector *b = vkhel_vector_create(g_ctx, vector_len);
+	vkhel_vector_copy_from_host(b, b_elements);
+	struct vkhel_vector *c = vkhel_vector_create(g_ctx, vector_len);
+	struct vkhel_vector *d = vkhel_vector_create(g_ctx, vector_len);
+
+	/* every op depends on the one before it */
+	struct vkhel_batch *batch = vkhel_batch_begin(g_ctx);
+	vkhel_batch_elemmul(batch, a, b, c, modulus);
+	vkhel_batch_elemfma(batch, c, b, d, 2, modulus);
+	vkhel_batch_elemmul(batch, d, a, d, modulus);
+	vkhel_batch_submit(batch);
+
+	const uint64_t c_expected[] = { 9, 20, 33, 48, 65, 84, 105, 128 };
+	assert_vector_contents_equal(c, c_expected, vector_len);
+	const uint64_t d_expected[] = { 27, 100, 231, 432, 715, 323, 37, 638 };
+	assert_vector_contents_equal(d, d_expected, vector_len);
+
+	vkhel_vector_destroy(a);
+	vkhel_vector_destroy(b);
+	vkhel_vector_destroy(c);
+	vkhel_vector_destroy(d);
+}
+
+void test_async() {
+	const size_t vector_len = 8;
+	const uint64_t a_elements[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	const uint64_t b_elements[] = { 9, 10, 11, 12, 13, 14, 15, 16 };
+	const uint64_t modulus = 769;
+
+	struct vkhel_vector *a = vkhel_vector_create(g_ctx, vector_len);
+	vkhel_vector_copy_from_host(a, a_elements);
+	struct vkhel_vector *b = vkhel_vector_create(g_ctx, vector_len);
+	vkhel_vector_copy_from_host(b, b_elements);
+	struct vkhel_vector *c = vkhel_vector_create(g_ctx, vector_len);
+	struct vkhel_vector *d = vkhel_vector_create(g_ctx, vector_len);
+
+	/* the second op reads the result of the first, still in flight */
+	struct vkhel_event *events[] = {
+		vkhel_vector_elemmul_async(a, b, c, modulus),
+		vkhel_vector_elemfma_async(c, b, d, 2, modulus),
+	};
+	vkhel_event_wait_all(events, 2);
+
+	const uint64_t c_expected[] = { 9, 20, 33, 48, 65, 84, 105, 128 };
+	assert_vector_contents_equal(c, c_expected, vector_len);
+	const uint64_t d_expected[] = { 27, 50, 77, 108, 143, 182, 225, 272 };
+	assert_vector_contents_equal(d, d_expected, vector_len);
+
+	struct vkhel_event *event = vkhel_vector_elemmul_async(d, a, d, modulus);
+	while (!vkhel_event_poll(event));
+	vkhel_event_wait(event);
+
+	const uint64_t d2_expected[] = { 27, 100, 231, 432, 715, 323, 37, 638 };
+	assert_vector_contents_equal(d, d2_expected, vector_len);
+
+	vkhel_vector_destroy(a);
+	vkhel_vector_destroy(b);
+	vkhel_vector_destroy(c);
+	vkhel_vector_destroy(d);
+}
+
+static void descriptor_cache_run(struct vkhel_ctx *ctx) {
+	/* vectors are recreated, so any stale cached set would point at a
+	 * destroyed buffer */
+	for (size_t i = 0; i < 3; i++) {
+		check_elemmul(ctx, 4, 17);
+		check_elemmul(ctx, CHECK_ELEMMUL_LENGTH, 17);
+	}
+}
+
+void test_descriptor_cache() {
+	descriptor_cache_run(g_ctx);
+
+	/* the same through cached descriptor sets */
+	struct vkhel_ctx_options options;
+	vkhel_ctx_options_init(&options);
+	options.push_descriptors = false;
+	struct vkhel_ctx *ctx = vkhel_ctx_create_with_options(&options);
+	assert(ctx != NULL);
+	assert(!ctx->vk.push_descriptor);
+	descriptor_cache_run(ctx);
+	vkhel_ctx_destroy(ctx);
+}
+
+void test_descriptor_cache_reuse() {
+	/* unpooled buffers, so every destroy frees the sets using them */
+	struct vkhel_ctx_options options;
+	vkhel_ctx_options_init(&options);
+	options.push_descriptors = false;
+	options.pool_bytes = 0;
+	struct vkhel_ctx *ctx = vkhel_ctx_create_with_options(&options);
+	assert(ctx != NULL);
+
+	const uint64_t a_elements[] = { 1, 2, 3, 4 };
+	struct vkhel_vector *a = vkhel_vector_create(ctx, 4);
+	vkhel_vector_copy_from_host(a, a_elements);
+
+	/* freed sets are allocated again instead of filling new pools */
+	for (size_t i = 0; i < 2 * DESCRIPTOR_CACHE_POOL_SETS; i++) {
+		struct vkhel_vector *c = vkhel_vector_create(ctx, 4);
+		vkhel_vector_elemmul(a, a, c, 17);
+		vkhel_vector_destroy(c);
+	}
+	assert(ctx->vk.descriptor_cache.pool_count == 1);
+
+	vkhel_vector_destroy(a);
+	vkhel_ctx_destroy(ctx);
+}
+
+void test_descriptor_cache_bound() {
+	struct vkhel_ctx_options options;
+	vkhel_ctx_options_init(&options);
+	options.push_descriptors = false;
+	options.pool_bytes = 1 << 20;
+	struct vkhel_ctx *ctx = vkhel_ctx_create_with_options(&options);
+	assert(ctx != NULL);
+	const struct descriptor_cache *cache = &ctx->vk.descriptor_cache;
+
+	/* views at ever new offsets of a buffer that stays alive */
+	const size_t view_count = 2 * DESCRIPTOR_CACHE_POOL_SETS;
+	const size_t stride = (ctx->vk.min_storage_buffer_offset_alignment
+			+ sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	struct vkhel_vector *parent = vkhel_vector_create(ctx,
+			view_count * stride);
+	for (size_t i = 0; i < view_count; i++) {
+		struct vkhel_vector *view = vkhel_vector_view(parent, i * stride,
+				stride);
+		vkhel_vector_elemmul(view, view, view, 17);
+		vkhel_vector_destroy(view);
+	}
+	assert(cache->entry_count == 0);
+	vkhel_vector_destroy(parent);
+
+	/* a pooled buffer handed out again with other lengths of its class */
+	for (size_t i = 0; i < view_count; i++) {
+		struct vkhel_vector *c = vkhel_vector_create(ctx, 256 - i % 128);
+		vkhel_vector_elemmul(c, c, c, 17);
+		vkhel_vector_destroy(c);
+	}
+	assert(ctx->pool.retained_bytes != 0);
+	assert(cache->entry_count == 0);
+	assert(cache->pool_count == 1);
+
+	vkhel_ctx_destroy(ctx);
+}
+
+struct threads_job {
+	struct vkhel_ctx *ctx;
+	struct vkhel_ntt_tables *ntt_tables;
+};
+
+static void *threads_worker(void *data) {
+	const struct threads_job *job = data;
+	const size_t vector_len = 4;
+	const uint64_t operand[] = { 94, 109, 11, 18 };
+	const uint64_t transformed[] = { 82, 2, 81, 98 };
+
+	for (size_t i = 0; i < 16; i++) {
+		struct vkhel_vector *a = vkhel_vector_create(job->ctx, vector_len);
+		vkhel_vector_copy_from_host(a, operand);
+		struct vkhel_vector *b = vkhel_vector_create(job->ctx, vector_len);
+
+		vkhel_vector_forward_transform(a, b, job->ntt_tables);
+		assert_vector_contents_equal(b, transformed, vector_len);
+		vkhel_vector_inverse_transform(b, b, job->ntt_tables);
+		assert_vector_contents_equal(b, operand, vector_len);
+
+		vkhel_vector_destroy(a);
+		vkhel_vector_destroy(b);
+	}
+	return NULL;
+}
+
+/* runs the worker on four threads, spread over the contexts */
+static void run_threads(struct vkhel_ctx **ctxs, size_t ctx_count,
+		struct vkhel_ntt_tables *ntt_tables) {
+	pthread_t threads[4];
+	struct threads_job jobs[4];
+	for (size_t i = 0; i < 4; i++) {
+		jobs[i] = (struct threads_job) {
+			.ctx = ctxs[i % ctx_count],
+			.ntt_tables = ntt_tables,
+		};
+		int err = pthread_create(&threads[i], NULL, threads_worker,
+				&jobs[i]);
+		assert(err == 0);
+	}
+	for (size_t i = 0; i < 4; i++) {
+		pthread_join(threads[i], NULL);
+	}
+}
+
+void test_threads() {
+	struct vkhel_ntt_tables *ntt_tables = vkhel_ntt_tables_create(4, 113, 18);
+	run_threads(&g_ctx, 1, ntt_tables);
+	vkhel_ntt_tables_destroy(ntt_tables);
+}
+
+void test_shared_tables() {
+	/* each context gets its own device copy of the tables, which stays
+	 * alive while the other context uploads and uses its own */
+	struct vkhel_ctx *ctxs[] = { vkhel_ctx_create(), vkhel_ctx_create() };
+	struct vkhel_ntt_tables *ntt_tables = vkhel_ntt_tables_create(4, 113, 18);
+	run_threads(ctxs, 2, ntt_tables);
+	vkhel_ntt_tables_destroy(ntt_tables);
+
+	vkhel_ctx_destroy(ctxs[0]);
+	vkhel_ctx_destroy(ctxs[1]);
+}
+
+static void multi_ctx_job(struct vkhel_ctx *ctx, size_t index, void *data) {
+	uint64_t *results = data;
+	const uint64_t a_elements[] = { index, index + 1 };
+	const uint64_t b_elements[] = { 3, 5 };
+
+	struct vkhel_vector *a = vkhel_vector_create(ctx, 2);
+	vkhel_vector_copy_from_host(a, a_elements);
+	struct vkhel_vector *b = vkhel_vector_create(ctx, 2);
+	vkhel_vector_copy_from_host(b, b_elements);
+	vkhel_vector_elemmul(a, b, a, 1009);
+
+	uint64_t *mapped;
+	vkhel_vector_map(a, (void **) &mapped, 2 * sizeof(uint64_t));
+	results[2 * index] = mapped[0];
+	results[2 * index + 1] = mapped[1];
+	vkhel_vector_unmap(a);
+
+	vkhel_vector_destroy(a);
+	vkhel_vector_destroy(b);
+}
+
+void test_multi_ctx() {
+	struct vkhel_multi_ctx *multi = vkhel_multi_ctx_create();
+	assert(vkhel_multi_ctx_device_count(multi) >= 1);
+
+	const size_t job_count = 8;
+	uint64_t results[2 * job_count];
+	vkhel_multi_ctx_shard(multi, job_count, multi_ctx_job, results);
+	for (size_t i = 0; i < job_count; i++) {
+		assert(results[2 * i] == 3 * i);
+		assert(results[2 * i + 1] == 5 * (i + 1));
+	}
+
+	vkhel_multi_ctx_destroy(multi);
+}
+
+void test_ctx_options() {
+	struct vkhel_ctx_options options;
+	vkhel_ctx_options_init(&options);
+	options.device_name = "no device is called this";
+	assert(vkhel_ctx_create_with_options(&options) == NULL);
+
+	vkhel_ctx_options_init(&options);
+	options.device_index = 0;
+	options.queue_count = 2;
+	options.pipeline_cache = false;
+	options.memory_budget = 64 * 1024 * 1024;
+	struct vkhel_ctx *ctx = vkhel_ctx_create_with_options(&options);
+	assert(ctx != NULL);
+
+	check_elemmul(ctx, CHECK_ELEMMUL_LENGTH, 17);
+	vkhel_ctx_destroy(ctx);
+}
+
+void test_pipeline_cache_file() {
+	const char *path = "vkhel_test_pipeline_cache.bin";
+	remove(path);
+
+	struct vkhel_ctx_options options;
+	vkhel_ctx_options_init(&options);
+	options.pipeline_cache_path = path;
+	vkhel_ctx_destroy(vkhel_ctx_create_with_options(&options));
+
+	FILE *file = fopen(path, "rb");
+	assert(file != NULL);
+	fclose(file);
+
+	/* kernels still work when created from the loaded cache */
+	struct vkhel_ctx *ctx = vkhel_ctx_create_with_options(&options);
+	check_elemmul(ctx, CHECK_ELEMMUL_LENGTH, 17);
+	vkhel_ctx_destroy(ctx);
+
+	/* a garbage file is ignored rather than handed to the driver */
+	file = fopen(path, "wb");
+	fputs("not a pipeline cache", file);
+	fclose(file);
+	vkhel_ctx_destroy(vkhel_ctx_create_with_options(&options));
+
+	remove(path);
+}
+
+void test_prewarm() {
+	struct vkhel_ctx *ctx = vkhel_ctx_create();
+	vkhel_ctx_prewarm_async(ctx, VKHEL_KERNEL_NTT);
+	vkhel_ctx_prewarm(ctx, VKHEL_KERNEL_ELEMMUL);
+
+	check_elemmul(ctx, CHECK_ELEMMUL_LENGTH, 17);
+	/* destroying while the background prewarm may still run */
+	vkhel_ctx_destroy(ctx);
+}
+
+void test_specialize() {
+	struct vkhel_ctx *ctx = vkhel_ctx_create();
+	vkhel_ctx_specialize(ctx, 17, 128);
+	/* again with the same constants is a no-op */
+	vkhel_ctx_specialize(ctx, 17, 128);
+
+	check_elemmul(ctx, CHECK_ELEMMUL_LENGTH, 17);
+	/* other moduli still take the generic pipelines */
+	check_elemmul(ctx, CHECK_ELEMMUL_LENGTH, 13);
+	vkhel_ctx_specialize(ctx, 13, 0);
+
+	/* retuning rebuilds the variants in the new shape, keeping only a
+	 * local size that was asked for */
+	struct vulkan_kernel *kernel =
+		vulkan_ctx_kernel(&ctx->vk, VULKAN_KERNEL_TYPE_ELEMMUL);
+	vulkan_ctx_set_kernel_shape(&ctx->vk, VULKAN_KERNEL_TYPE_ELEMMUL, 32, 4);
+	const struct vulkan_kernel_variant *variant_17 =
+		vulkan_kernel_find_variant(kernel, 17);
+	assert(variant_17 != NULL);
+	assert(variant_17->local_size == 128);
+	assert(variant_17->elements_per_invocation == 4);
+	const struct vulkan_kernel_variant *variant_13 =
+		vulkan_kernel_find_variant(kernel, 13);
+	assert(variant_13 != NULL);
+	assert(variant_13->local_size == 32);
+	assert(variant_13->elements_per_invocation == 4);
+	check_elemmul(ctx, CHECK_ELEMMUL_LENGTH, 17);
+	check_elemmul(ctx, CHECK_ELEMMUL_LENGTH, 13);
+
+	/* the newest variant of a modulus is the one dispatched, and the
+	 * older one is dropped by the next shape change */
+	vkhel_ctx_specialize(ctx, 17, 64);
+	assert(vulkan_kernel_find_variant(kernel, 17)->local_size == 64);
+	vulkan_ctx_set_kernel_shape(&ctx->vk, VULKAN_KERNEL_TYPE_ELEMMUL, 32, 2);
+	size_t variants_17 = 0;
+	for (const struct vulkan_kernel_variant *variant = kernel->variants;
+			variant != NULL; variant = variant->next) {
+		variants_17 += variant->mod == 17;
+	}
+	assert(variants_17 == 1);
+	assert(vulkan_kernel_find_variant(kernel, 17)->local_size == 64);
+	assert(vulkan_kernel_find_variant(kernel, 17)
+			->elements_per_invocation == 2);
+	check_elemmul(ctx, CHECK_ELEMMUL_LENGTH, 17);
+
+	vkhel_ctx_destroy(ctx);
+}
+
+void test_autotune() {
+	const char *path = "vkhel_test_tuning.txt";
+	remove(path);
+
+	/* a plan recorded before tuning still runs once the kernels it
+	 * recorded are rebuilt with other shapes */
+	struct vkhel_ctx *ctx = vkhel_ctx_create();
+	struct vkhel_ntt_tables *ntt = create_plan_tables();
+	struct vkhel_vector *vec = vkhel_vector_create2(ctx, 16, false);
+	struct vkhel_ntt_plan *plan = vkhel_ntt_plan_create(ntt, vec, vec);
+	assert(vkhel_ctx_autotune(ctx, path));
+	vkhel_vector_copy_from_host(vec, plan_expected);
+	vkhel_ntt_plan_inverse(plan);
+	assert_vector_contents_equal(vec, plan_elements, 16);
+	vkhel_ntt_plan_forward(plan);
+	assert_vector_contents_equal(vec, plan_expected, 16);
+
+	/* only the pipeline the plan recorded is kept, not every candidate */
+	struct vulkan_kernel *kernel =
+		&ctx->vk.kernels[VULKAN_KERNEL_TYPE_ELEMMULCONST];
+	assert(kernel->retired != NULL && kernel->retired->next == NULL);
+	vkhel_ntt_plan_destroy(plan);
+	assert(kernel->retired == NULL);
+
+	/* with no plan left, retuning keeps nothing */
+	assert(vkhel_ctx_autotune(ctx, NULL));
+	for (size_t i = 0; i < VULKAN_KERNEL_TYPE_MAX; i++) {
+		assert(ctx->vk.kernels[i].retired == NULL);
+	}
+	vkhel_vector_destroy(vec);
+	vkhel_ntt_tables_destroy(ntt);
+	vkhel_ctx_destroy(ctx);
+
+	struct vkhel_ctx_options options;
+	vkhel_ctx_options_init(&options);
+	options.tuning_path = path;
+	ctx = vkhel_ctx_create_with_options(&options);
+	check_elemmul(ctx, CHECK_ELEMMUL_LENGTH, 17);
+	vkhel_ctx_destroy(ctx);
+	remove(path);
+}
+
+static void pairs_run(uint32_t elements_per_invocation) {
+	const uint64_t modulus = 769;
+	const uint64_t bound = modulus / 2;
+	struct vkhel_ctx *ctx = vkhel_ctx_create();
+	const enum vulkan_kernel_type types[] = {
+		VULKAN_KERNEL_TYPE_ELEMFMA,
+		VULKAN_KERNEL_TYPE_ELEMMUL,
+		VULKAN_KERNEL_TYPE_ELEMGTADD,
+		VULKAN_KERNEL_TYPE_ELEMGTSUB,
+		VULKAN_KERNEL_TYPE_ELEMMULCONST,
+		VULKAN_KERNEL_TYPE_ELEMMODBYTWO,
+	};
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+		vulkan_ctx_set_kernel_shape(&ctx->vk, types[i], 32,
+				elements_per_invocation);
+	}
+	/* few enough groups that every invocation loops over several pairs,
+	 * and odd, so the last element takes the scalar path */
+	ctx->vk.max_group_count = 2;
+	const size_t vector_len = 3 * 2 * 32 * elements_per_invocation + 1;
+
+	uint64_t *a_elements = malloc(vector_len * sizeof(uint64_t));
+	uint64_t *b_elements = malloc(vector_len * sizeof(uint64_t));
+	uint64_t *x_elements = malloc(vector_len * sizeof(uint64_t));
+	uint64_t *expected = malloc(vector_len * sizeof(uint64_t));
+	assert(a_elements != NULL && b_elements != NULL && x_elements != NULL
+			&& expected != NULL);
+	for (size_t i = 0; i < vector_len; i++) {
+		/* small enough that a * 2 + b stays below the modulus */
+		a_elements[i] = (i * 7) % 256;
+		b_elements[i] = (i * 13) % 128;
+		x_elements[i] = (i * 37) % modulus;
+	}
+
+	struct vkhel_vector *a = vkhel_vector_create(ctx, vector_len);
+	vkhel_vector_copy_from_host(a, a_elements);
+	struct vkhel_vector *b = vkhel_vector_create(ctx, vector_len);
+	vkhel_vector_copy_from_host(b, b_elements);
+	struct vkhel_vector *x = vkhel_vector_create(ctx, vector_len);
+	vkhel_vector_copy_from_host(x, x_elements);
+	struct vkhel_vector *c = vkhel_vector_create(ctx, vector_len);
+
+	vkhel_vector_elemfma(a, b, c, 2, modulus);
+	for (size_t i = 0; i < vector_len; i++) {
+		expected[i] = a_elements[i] * 2 + b_elements[i];
+	}
+	assert_vector_contents_equal(c, expected, vector_len);
+
+	vkhel_vector_elemmul(x, a, c, modulus);
+	for (size_t i = 0; i < vector_len; i++) {
+		expected[i] = x_elements[i] * a_elements[i] % modulus;
+	}
+	assert_vector_contents_equal(c, expected, vector_len);
+
+	vkhel_vector_elemgtadd(x, c, bound, 3);
+	for (size_t i = 0; i < vector_len; i++) {
+		expected[i] = x_elements[i] > bound
+			? x_elements[i] + 3 : x_elements[i];
+	}
+	assert_vector_contents_equal(c, expected, vector_len);
+
+	vkhel_vector_elemgtsub(x, c, bound, 5, modulus);
+	for (size_t i = 0; i < vector_len; i++) {
+		expected[i] = x_elements[i] > bound
+			? (x_elements[i] + modulus - 5) % modulus : x_elements[i];
+	}
+	assert_vector_contents_equal(c, expected, vector_len);
+
+	/* only inverse transforms use it, so it's recorded directly */
+	struct vulkan_execution execution;
+	vulkan_ctx_execution_begin(&ctx->vk, &execution,
+			VULKAN_QUEUE_TYPE_COMPUTE);
+	vulkan_kernel_elemmulconst_record(&ctx->vk,
+			vulkan_ctx_kernel(&ctx->vk, VULKAN_KERNEL_TYPE_ELEMMULCONST),
+			&execution, c, x, 3, modulus);
+	vulkan_ctx_execution_submit_wait(&ctx->vk, &execution);
+	for (size_t i = 0; i < vector_len; i++) {
+		expected[i] = x_elements[i] * 3 % modulus;
+	}
+	assert_vector_contents_equal(c, expected, vector_len);
+
+	vkhel_vector_elemmod(x, c, 2, modulus);
+	for (size_t i = 0; i < vector_len; i++) {
+		const uint64_t parity = x_elements[i] & 1;
+		expected[i] = x_elements[i] > bound ? 1 - parity : parity;
+	}
+	assert_vector_contents_equal(c, expected, vector_len);
+
+	check_elemmul(ctx, CHECK_ELEMMUL_LENGTH, 17);
+
+	vkhel_vector_destroy(a);
+	vkhel_vector_destroy(b);
+	vkhel_vector_destroy(x);
+	vkhel_vector_destroy(c);
+	free(a_elements);
+	free(b_elements);
+	free(x_elements);
+	free(expected);
+	vkhel_ctx_destroy(ctx);
+}
+
+void test_pairs() {
+	pairs_run(4);
+	pairs_run(8);
+}
+
+/* a context that never maps vector memory in place, so host accesses go
+ * through the staging ring on every device */
+static struct vkhel_ctx *create_staged_ctx() {
+	struct vkhel_ctx_options options;
+	vkhel_ctx_options_init(&options);
+	options.host_visible_vectors = false;
+	struct vkhel_ctx *ctx = vkhel_ctx_create_with_options(&options);
+	assert(ctx != NULL);
+	assert(!ctx->vk.unified_memory);
+	return ctx;
+}
+
+static void staging_run(struct vkhel_ctx *ctx) {
+	/* wraps around the ring, and ends in a partial chunk */
+	const size_t vector_len = (STAGING_CHUNK_COUNT + 2) * STAGING_CHUNK_SIZE
+		/ sizeof(uint64_t) + 3;
+	uint64_t *elements = malloc(vector_len * sizeof(uint64_t));
+	assert(elements != NULL);
+	for (size_t i = 0; i < vector_len; i++) {
+		elements[i] = i * 0x9e3779b97f4a7c15;
+	}
+
+	struct vkhel_vector *a = vkhel_vector_create(ctx, vector_len);
+	vkhel_vector_copy_from_host(a, elements);
+	assert_vector_contents_equal(a, elements, vector_len);
+
+	/* only the mapped prefix is written back */
+	uint64_t *mapped;
+	vkhel_vector_map(a, (void **) &mapped, 2 * sizeof(uint64_t));
+	mapped[0] = 7;
+	mapped[1] = 11;
+	vkhel_vector_unmap(a);
+	elements[0] = 7;
+	elements[1] = 11;
+	assert_vector_contents_equal(a, elements, vector_len);
+
+	vkhel_vector_destroy(a);
+	free(elements);
+}
+
+void test_staging() {
+	staging_run(g_ctx);
+
+	struct vkhel_ctx *ctx = create_staged_ctx();
+	staging_run(ctx);
+	vkhel_ctx_destroy(ctx);
+}
+
+void test_unified_memory() {
+	const uint64_t a_elements[] = { 1, 2, 3, 4 };
+	struct vkhel_vector *a = vkhel_vector_create(g_ctx, 4);
+	vkhel_vector_copy_from_host(a, a_elements);
+
+	/* writes through the mapping reach kernels, and the device storage
+	 * itself is mapped when it is host visible */
+	uint64_t *mapped;
+	vkhel_vector_map(a, (void **) &mapped, 4 * sizeof(uint64_t));
+	mapped[3] = 5;
+	if (g_ctx->vk.unified_memory) {
+		assert(a->device.mapped != NULL);
+		assert(mapped == a->device.mapped);
+	}
+	vkhel_vector_unmap(a);
+
+	vkhel_vector_elemmul(a, a, a, 17);
+	const uint64_t expected[] = { 1, 4, 9, 8 };
+	assert_vector_contents_equal(a, expected, 4);
+
+	vkhel_vector_destroy(a);
+	check_elemmul(g_ctx, CHECK_ELEMMUL_LENGTH, 17);
+
+	/* with the option off, the device storage is never mapped */
+	struct vkhel_ctx *ctx = create_staged_ctx();
+	struct vkhel_vector *b = vkhel_vector_create(ctx, 4);
+	vkhel_vector_copy_from_host(b, a_elements);
+	assert(b->device.mapped == NULL);
+	assert_vector_contents_equal(b, a_elements, 4);
+	vkhel_vector_destroy(b);
+	check_elemmul(ctx, CHECK_ELEMMUL_LENGTH, 17);
+	vkhel_ctx_destroy(ctx);
+}
+
+static void map_range_run(struct vkhel_ctx *ctx) {
+	const uint64_t elements[] = { 1, 2, 3, 4, 5, 6 };
+	struct vkhel_vector *a = vkhel_vector_create(ctx, 6);
+	vkhel_vector_copy_from_host(a, elements);
+
+	const uint64_t *read = vkhel_vector_map_range(a, 2 * sizeof(uint64_t),
+			3 * sizeof(uint64_t), VKHEL_MAP_READ);
+	assert(read[0] == 3 && read[1] == 4 && read[2] == 5);
+	vkhel_vector_unmap(a);
+
+	uint64_t *write = vkhel_vector_map_range(a, 1 * sizeof(uint64_t),
+			2 * sizeof(uint64_t), VKHEL_MAP_WRITE_DISCARD);
+	write[0] = 20;
+	write[1] = 30;
+	vkhel_vector_unmap(a);
+
+	uint64_t *update = vkhel_vector_map_range(a, 4 * sizeof(uint64_t),
+			2 * sizeof(uint64_t), VKHEL_MAP_READ_WRITE);
+	update[0] += 50;
+	update[1] += 60;
+	vkhel_vector_unmap(a);
+
+	/* bytes outside the ranges are untouched */
+	const uint64_t expected[] = { 1, 20, 30, 4, 55, 66 };
+	assert_vector_contents_equal(a, expected, 6);
+
+	vkhel_vector_destroy(a);
+}
+
+void test_map_range() {
+	map_range_run(g_ctx);
+
+	struct vkhel_ctx *ctx = create_staged_ctx();
+	map_range_run(ctx);
+	vkhel_ctx_destroy(ctx);
+}
+
+static void copy_many_run(struct vkhel_ctx *ctx) {
+	/* a chunk boundary falls inside the last vector */
+	const size_t lengths[] = { 5, 1, 1024,
+		STAGING_CHUNK_SIZE / sizeof(uint64_t) };
+	const size_t count = sizeof(lengths) / sizeof(lengths[0]);
+
+	struct vkhel_vector *vectors[count];
+	uint64_t *src[count];
+	uint64_t *dst[count];
+	for (size_t i = 0; i < count; i++) {
+		vectors[i] = vkhel_vector_create(ctx, lengths[i]);
+		src[i] = malloc(lengths[i] * sizeof(uint64_t) + 1);
+		dst[i] = malloc(lengths[i] * sizeof(uint64_t) + 1);
+		assert(src[i] != NULL && dst[i] != NULL);
+		for (size_t j = 0; j < lengths[i]; j++) {
+			src[i][j] = i * 1000003 + j;
+		}
+	}
+
+	vkhel_vectors_copy_from_host_many(vectors,
+			(const uint64_t *const *) src, count);
+	vkhel_vectors_copy_to_host_many(
+			(const struct vkhel_vector *const *) vectors, dst, count);
+	for (size_t i = 0; i < count; i++) {
+		for (size_t j = 0; j < lengths[i]; j++) {
+			assert(dst[i][j] == src[i][j]);
+		}
+		assert_vector_contents_equal(vectors[i], src[i], lengths[i]);
+	}
+
+	vkhel_vector_copy_to_host(vectors[0], dst[0]);
+	for (size_t j = 0; j < lengths[0]; j++) {
+		assert(dst[0][j] == src[0][j]);
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		vkhel_vector_destroy(vectors[i]);
+		free(src[i]);
+		free(dst[i]);
+	}
+}
+
+void test_copy_many() {
+	copy_many_run(g_ctx);
+
+	/* on unified memory devices the copies above are done in place, this
+	 * one packs them into the staging ring */
+	struct vkhel_ctx *ctx = create_staged_ctx();
+	copy_many_run(ctx);
+	vkhel_ctx_destroy(ctx);
+}
+
+void test_pool() {
+	struct vkhel_ctx_options options;
+	vkhel_ctx_options_init(&options);
+	options.pool_bytes = 16384;
+	options.pool_buffers_per_class = 1;
+	struct vkhel_ctx *ctx = vkhel_ctx_create_with_options(&options);
+	assert(ctx != NULL);
+
+	const uint64_t elements[] = { 1, 2, 3 };
+	struct vkhel_vector *a = vkhel_vector_create(ctx, 3);
+	vkhel_vector_copy_from_host(a, elements);
+	const VkBuffer buffer = a->device.buffer;
+	vkhel_vector_destroy(a);
+	assert(ctx->pool.retained_bytes == 256);
+
+	/* the buffer comes back for any length in its class, cleared */
+	struct vkhel_vector *b = vkhel_vector_create(ctx, 32);
+	assert(b->device.buffer == buffer);
+	assert(ctx->pool.retained_bytes == 0);
+	const uint64_t zeros[32] = {0};
+	assert_vector_contents_equal(b, zeros, 32);
+
+	/* only one buffer per class is kept */
+	struct vkhel_vector *c = vkhel_vector_create(ctx, 3);
+	vkhel_vector_destroy(b);
+	vkhel_vector_destroy(c);
+	assert(ctx->pool.retained_bytes == 256);
+
+	struct vkhel_vector *d = vkhel_vector_create(ctx, 1024);
+	vkhel_vector_destroy(d);
+	assert(ctx->pool.retained_bytes == 256 + 8192);
+	vkhel_ctx_trim(ctx, 256);
+	assert(ctx->pool.retained_bytes == 256);
+	vkhel_ctx_trim(ctx, 0);
+	assert(ctx->pool.retained_bytes == 0);
+
+	/* a class larger than the pool is never retained, nor rounded up */
+	struct vkhel_vector *e = vkhel_vector_create(ctx, 4097);
+	assert(e->device.size == 4097 * sizeof(uint64_t));
+	vkhel_vector_destroy(e);
+	assert(ctx->pool.retained_bytes == 0);
+
+	vkhel_ctx_destroy(ctx);
+}
+
+void test_views() {
+	/* far enough apart for any minStorageBufferOffsetAlignment */
+	const size_t stride = 64;
+	const uint64_t operand[] = { 94, 109, 11, 18 };
+	const uint64_t transformed[] = { 82, 2, 81, 98 };
+
+	struct vkhel_vector *parent = vkhel_vector_create(g_ctx, 3 * stride);
+	struct vkhel_vector *limbs[3];
+	for (size_t i = 0; i < 3; i++) {
+		limbs[i] = vkhel_vector_view(parent, i * stride, 4);
+	}
+	vkhel_vector_copy_from_host(limbs[0], operand);
+
+	struct vkhel_ntt_tables *ntt_tables = vkhel_ntt_tables_create(4, 113, 18);
+	vkhel_vector_forward_transform(limbs[0], limbs[1], ntt_tables);
+	assert_vector_contents_equal(limbs[1], transformed, 4);
+	vkhel_ntt_tables_destroy(ntt_tables);
+
+	/* a view of a view, and a batch whose second op overwrites a view
+	 * the first one reads */
+	struct vkhel_vector *inner = vkhel_vector_view(limbs[1], 0, 4);
+	struct vkhel_batch *batch = vkhel_batch_begin(g_ctx);
+	vkhel_batch_elemmul(batch, limbs[0], inner, limbs[2], 17);
+	vkhel_batch_elemgtadd(batch, limbs[0], limbs[0], 100, 1);
+	vkhel_event_wait(vkhel_batch_submit_async(batch));
+
+	const uint64_t product[] = { 94 * 82 % 17, 109 * 2 % 17,
+		11 * 81 % 17, 18 * 98 % 17 };
+	assert_vector_contents_equal(limbs[2], product, 4);
+
+	/* everything outside the views is untouched */
+	uint64_t *expected = calloc(3 * stride, sizeof(uint64_t));
+	for (size_t i = 0; i < 4; i++) {
+		expected[i] = operand[i] > 100 ? operand[i] + 1 : operand[i];
+		expected[stride + i] = transformed[i];
+		expected[2 * stride + i] = product[i];
+	}
+	assert_vector_contents_equal(parent, expected, 3 * stride);
+	free(expected);
+
+	vkhel_vector_destroy(inner);
+	for (size_t i = 0; i < 3; i++) {
+		vkhel_vector_destroy(limbs[i]);
+	}
+	vkhel_vector_destroy(parent);
+}
+
+void test_unaligned_view() {
+	/* pair loads need 16 byte offsets, a view at an odd element has to
+	 * fall back to the scalar pipeline */
+	struct vkhel_ctx *ctx = vkhel_ctx_create();
+	vulkan_ctx_set_kernel_shape(&ctx->vk, VULKAN_KERNEL_TYPE_ELEMMUL, 32, 2);
+
+	VkDescriptorBufferInfo buffers[] = {
+		{ .buffer = VK_NULL_HANDLE, .offset = 0, .range = VK_WHOLE_SIZE },
+		{ .buffer = VK_NULL_HANDLE, .offset = 16, .range = VK_WHOLE_SIZE },
+	};
+	assert(vulkan_kernel_pair_aligned(buffers, 2));
+	buffers[1].offset = sizeof(uint64_t);
+	assert(!vulkan_kernel_pair_aligned(buffers, 2));
+
+	struct vulkan_kernel *kernel =
+		vulkan_ctx_kernel(&ctx->vk, VULKAN_KERNEL_TYPE_ELEMMUL);
+	const VkPipeline scalar = vulkan_kernel_scalar_pipeline(&ctx->vk, kernel);
+	assert(scalar != VK_NULL_HANDLE && scalar != kernel->pipeline);
+	assert(vulkan_kernel_scalar_pipeline(&ctx->vk, kernel) == scalar);
+
+	/* views can only start at multiples of the device's alignment */
+	if (ctx->vk.min_storage_buffer_offset_alignment > sizeof(uint64_t)) {
+		printf("unaligned_view: SKIP views at odd elements, offset "
+				"alignment is %" PRIu64 "\n",
+				(uint64_t) ctx->vk.min_storage_buffer_offset_alignment);
+		vkhel_ctx_destroy(ctx);
+		return;
+	}
+
+	const uint64_t elements[] = { 9, 1, 2, 3, 4, 5 };
+	struct vkhel_vector *a = vkhel_vector_create(ctx, 6);
+	vkhel_vector_copy_from_host(a, elements);
+	struct vkhel_vector *view = vkhel_vector_view(a, 1, 5);
+
+	vkhel_vector_elemmul(view, view, view, 17);
+	const uint64_t expected[] = { 9, 1, 4, 9, 16, 8 };
+	assert_vector_contents_equal(a, expected, 6);
+
+	vkhel_vector_destroy(view);
+	vkhel_vector_destroy(a);
+	vkhel_ctx_destroy(ctx);
+}
+
 void test_dup() {
 	const size_t vector_len = 64;
 	uint64_t elements[vector_len];
@@ -359,6 +1375,31 @@ int main() {
 	RUN_TEST(inverse_transform);
 	RUN_TEST(forward_transform_big);
 	RUN_TEST(inverse_transform_big);
+	RUN_TEST(transform_large);
+	RUN_TEST(elemmul_huge);
+	RUN_TEST(ntt_plan);
+	RUN_TEST(ntt_plan_threads);
+	RUN_TEST(batch);
+	RUN_TEST(async);
+	RUN_TEST(descriptor_cache);
+	RUN_TEST(descriptor_cache_reuse);
+	RUN_TEST(descriptor_cache_bound);
+	RUN_TEST(threads);
+	RUN_TEST(shared_tables);
+	RUN_TEST(multi_ctx);
+	RUN_TEST(ctx_options);
+	RUN_TEST(pipeline_cache_file);
+	RUN_TEST(prewarm);
+	RUN_TEST(specialize);
+	RUN_TEST(autotune);
+	RUN_TEST(pairs);
+	RUN_TEST(staging);
+	RUN_TEST(unified_memory);
+	RUN_TEST(map_range);
+	RUN_TEST(copy_many);
+	RUN_TEST(pool);
+	RUN_TEST(views);
+	RUN_TEST(unaligned_view);
 
 	vkhel_ctx_destroy(g_ctx);
 }